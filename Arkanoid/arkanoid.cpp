@@ -3,6 +3,21 @@
 #include <string>
 #include <unordered_map>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include "../SpaceShooter/ConsoleGameEnigne/Profiler.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ARKANOID_SSE2 1
+#endif
 
 struct position
 {
@@ -10,6 +25,21 @@ struct position
     int y;
 };
 
+// 16.16 fixed point, used for sub-cell ball and paddle positions
+typedef int32_t fixed;
+const int FIXED_SHIFT = 16;
+const fixed FIXED_ONE = 1 << FIXED_SHIFT;
+
+inline int fixedToCell(fixed v)
+{
+    return v >> FIXED_SHIFT; // arithmetic shift floors negative values too
+}
+
+inline fixed cellToFixed(int cell)
+{
+    return cell * FIXED_ONE;
+}
+
 struct Rect
 {
     int _x, _y;
@@ -250,6 +280,37 @@ public:
         }
     }
 
+    // Copies a full-screen layer over the buffer, blanking whatever the
+    // layer does not cover. Same-width layers are a single block copy.
+    void drawLayer(const CHAR_INFO layer[], int layerWidth, int layerHeight)
+    {
+        int rows = std::min(layerHeight, height);
+
+        if (layerWidth == width)
+        {
+            std::memcpy(buffer, layer, sizeof(CHAR_INFO) * width * rows);
+        }
+        else
+        {
+            int columns = std::min(layerWidth, width);
+            for (int y = 0; y < rows; y++)
+            {
+                std::memcpy(buffer + y * width, layer + y * layerWidth, sizeof(CHAR_INFO) * columns);
+                for (int x = columns; x < width; x++)
+                {
+                    buffer[y * width + x].Char.UnicodeChar = L' ';
+                    buffer[y * width + x].Attributes = 0;
+                }
+            }
+        }
+
+        for (int i = rows * width; i < height * width; i++)
+        {
+            buffer[i].Char.UnicodeChar = L' ';
+            buffer[i].Attributes = 0;
+        }
+    }
+
     void drawLine(int x0, int y0, int x1, int y1, wchar_t ch = L'*', WORD color = 7)
     {
         int dx = abs(x1 - x0);
@@ -337,55 +398,307 @@ public:
     }
 };
 
-class Ball
+// All balls stored as parallel arrays so the per-step integration runs
+// over contiguous memory, four balls per SSE2 instruction.
+class BallSet
 {
-private:
-    position pos;
-
 public:
-    Ball() = default;
+    std::vector<fixed> x, y;   // position in cells
+    std::vector<fixed> vx, vy; // cells per physics step, always under one cell
 
     wchar_t shape = L'O';
 
-    void setPosition(int x, int y)
+    size_t size() const
     {
-        pos.x = x;
-        pos.y = y;
+        return x.size();
     }
 
-    int getX()
+    void clear()
     {
-        return pos.x;
+        x.clear();
+        y.clear();
+        vx.clear();
+        vy.clear();
     }
 
-    int getY()
+    void add(fixed _x, fixed _y, fixed _vx, fixed _vy)
     {
-        return pos.y;
+        x.push_back(_x);
+        y.push_back(_y);
+        vx.push_back(std::max(-FIXED_ONE + 1, std::min(_vx, FIXED_ONE - 1)));
+        vy.push_back(std::max(-FIXED_ONE + 1, std::min(_vy, FIXED_ONE - 1)));
     }
 
-    position getPosition()
+    // swaps the last ball into slot i
+    void remove(size_t i)
     {
-        return pos;
+        x[i] = x.back();
+        y[i] = y.back();
+        vx[i] = vx.back();
+        vy[i] = vy.back();
+        x.pop_back();
+        y.pop_back();
+        vx.pop_back();
+        vy.pop_back();
     }
 
-    Rect getRect() const
+    int cellX(size_t i) const
     {
-        return {pos.x, pos.y, 1, 1};
+        return fixedToCell(x[i]);
     }
 
-    void move(int x, int y)
+    int cellY(size_t i) const
     {
-        pos.x += x;
-        pos.y += y;
+        return fixedToCell(y[i]);
+    }
+
+    // Advances every ball by its velocity and appends the index of each
+    // ball that entered a new cell to crossing. Those balls are moved back
+    // so the caller can resolve their move against the world.
+    void integrate(std::vector<int> &crossing)
+    {
+        size_t n = size();
+        size_t i = 0;
+
+#ifdef ARKANOID_SSE2
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128i px = _mm_loadu_si128((const __m128i *)&x[i]);
+            __m128i py = _mm_loadu_si128((const __m128i *)&y[i]);
+            __m128i nx = _mm_add_epi32(px, _mm_loadu_si128((const __m128i *)&vx[i]));
+            __m128i ny = _mm_add_epi32(py, _mm_loadu_si128((const __m128i *)&vy[i]));
+
+            __m128i sameX = _mm_cmpeq_epi32(_mm_srai_epi32(px, FIXED_SHIFT), _mm_srai_epi32(nx, FIXED_SHIFT));
+            __m128i sameY = _mm_cmpeq_epi32(_mm_srai_epi32(py, FIXED_SHIFT), _mm_srai_epi32(ny, FIXED_SHIFT));
+            int same = _mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(sameX, sameY)));
+
+            _mm_storeu_si128((__m128i *)&x[i], nx);
+            _mm_storeu_si128((__m128i *)&y[i], ny);
+
+            if (same != 0xF)
+            {
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    if ((same & (1 << lane)) == 0)
+                    {
+                        x[i + lane] -= vx[i + lane];
+                        y[i + lane] -= vy[i + lane];
+                        crossing.push_back((int)(i + lane));
+                    }
+                }
+            }
+        }
+#endif
+
+        for (; i < n; i++)
+        {
+            fixed nx = x[i] + vx[i];
+            fixed ny = y[i] + vy[i];
+            if (fixedToCell(nx) == fixedToCell(x[i]) && fixedToCell(ny) == fixedToCell(y[i]))
+            {
+                x[i] = nx;
+                y[i] = ny;
+            }
+            else
+            {
+                crossing.push_back((int)i);
+            }
+        }
     }
 };
 
+// Level files: a header followed by packed brick records, read straight
+// from a memory-mapped view.
+#pragma pack(push, 1)
+struct LevelHeader
+{
+    char magic[4]; // "ARKL"
+    uint16_t version;
+    uint16_t width; // play area in cells
+    uint16_t height;
+    uint32_t brickCount;
+};
+
+struct LevelBrick
+{
+    uint16_t x, y;
+    uint8_t w, h;
+    uint8_t power; // 1 for a multi-ball brick
+};
+#pragma pack(pop)
+
+const uint16_t LEVEL_VERSION = 1;
+
+// The brick field keeps about a dozen bytes per cell and one record per
+// brick, so bigger levels are refused rather than allocated.
+const long long LEVEL_MAX_CELLS = 1 << 24;
+const uint32_t LEVEL_MAX_BRICKS = 1 << 24;
+
+bool levelSizeOk(long long width, long long height)
+{
+    return width > 0 && height > 0 && width <= UINT16_MAX && height <= UINT16_MAX &&
+           width * height <= LEVEL_MAX_CELLS;
+}
+
+struct LevelView
+{
+    const LevelHeader *header;
+    const LevelBrick *bricks;
+};
+
+// A level built in memory, for the built-in layouts.
+struct Level
+{
+    LevelHeader header;
+    std::vector<LevelBrick> bricks;
+
+    Level(int width, int height)
+    {
+        std::memcpy(header.magic, "ARKL", 4);
+        header.version = LEVEL_VERSION;
+        header.width = (uint16_t)width;
+        header.height = (uint16_t)height;
+        header.brickCount = 0;
+    }
+
+    void add(int x, int y, int w = 1, int h = 1)
+    {
+        const int powerEvery = 40; // every 40th brick splits the ball that breaks it
+        bool power = bricks.size() % powerEvery == powerEvery / 2;
+        bricks.push_back({(uint16_t)x, (uint16_t)y, (uint8_t)w, (uint8_t)h, (uint8_t)power});
+        header.brickCount = (uint32_t)bricks.size();
+    }
+
+    LevelView view() const
+    {
+        return {&header, bricks.data()};
+    }
+
+    bool save(const std::string &path) const
+    {
+        std::ofstream out(path, std::ios::binary);
+        if (!out.is_open())
+            return false;
+        out.write((const char *)&header, sizeof(header));
+        out.write((const char *)bricks.data(), sizeof(LevelBrick) * bricks.size());
+        return out.good();
+    }
+};
+
+// Read-only mapping of a level file. The view stays valid until close().
+class LevelFile
+{
+private:
+    HANDLE file;
+    HANDLE mapping;
+    const uint8_t *data;
+
+public:
+    LevelFile() : file(INVALID_HANDLE_VALUE), mapping(NULL), data(nullptr) {}
+
+    ~LevelFile()
+    {
+        close();
+    }
+
+    bool open(const std::string &path)
+    {
+        close();
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart < (long long)sizeof(LevelHeader))
+        {
+            close();
+            return false;
+        }
+
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL)
+            data = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (data == nullptr)
+        {
+            close();
+            return false;
+        }
+
+        const LevelHeader *header = (const LevelHeader *)data;
+        long long expected = sizeof(LevelHeader) + (long long)header->brickCount * sizeof(LevelBrick);
+        if (std::memcmp(header->magic, "ARKL", 4) != 0 || header->version != LEVEL_VERSION || size.QuadPart < expected ||
+            !levelSizeOk(header->width, header->height) || header->brickCount > LEVEL_MAX_BRICKS)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (data != nullptr)
+            UnmapViewOfFile(data);
+        if (mapping != NULL)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        data = nullptr;
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+    }
+
+    LevelView view() const
+    {
+        return {(const LevelHeader *)data, (const LevelBrick *)(data + sizeof(LevelHeader))};
+    }
+};
+
+// The original 50 x 13 block, centred in the play area.
+Level makeBlockLevel(int width, int height, int brickCols = 50, int brickRows = 13)
+{
+    Level level(width, height);
+
+    // Create a grid of bricks
+    int brickW = 1;
+    int brickH = 1;
+    for (int row = 0; row < brickRows; row++)
+    {
+        for (int col = 0; col < brickCols; col++)
+        {
+            int x = col * (brickW) + (width - brickCols) / 2;
+            int y = row * (brickH) + 2;
+            level.add(x, y, brickW, brickH);
+        }
+    }
+    return level;
+}
+
+Level makeCircleLevel(int width, int height)
+{
+    Level level(width, height);
+    int centerX = width / 2;
+    int centerY = 5;
+    int radius = 5;      // distance from center
+    int brickCount = 60; // number of bricks in the circle
+
+    for (int i = 0; i < brickCount; ++i)
+    {
+        float angle = (2.0f * 3.14159f * i) / brickCount; // convert index to angle in radians
+
+        int x = static_cast<int>(centerX + radius * std::cos(angle));
+        int y = static_cast<int>(centerY + radius * sin(angle));
+
+        level.add(x, y);
+    }
+    return level;
+}
+
 class Brick
 {
 private:
     position pos;
     int width, height;
-    bool destroyed = false;
 
 public:
     Brick(int x, int y, int w = 1, int h = 1)
@@ -410,20 +723,173 @@ public:
         return {pos.x, pos.y, width, height};
     }
 
-    void draw(Window &win, wchar_t ch = L'.', WORD color = 7)
+    // rasterizes into a retained layer rather than the window buffer
+    void draw(CHAR_INFO layer[], int layerWidth, int layerHeight, wchar_t ch = L'.', WORD color = 7) const
+    {
+        for (int y = std::max(pos.y, 0); y < std::min(pos.y + height, layerHeight); y++)
+        {
+            for (int x = std::max(pos.x, 0); x < std::min(pos.x + width, layerWidth); x++)
+            {
+                layer[y * layerWidth + x].Char.UnicodeChar = ch;
+                layer[y * layerWidth + x].Attributes = color;
+            }
+        }
+    }
+};
+
+// Bricks indexed by the screen cells they cover, with destroyed flags kept
+// in a bitset. A lookup only visits the cells under the query rect, so its
+// cost does not grow with the number of bricks.
+//
+// The bricks are also rasterized once into a retained layer; destroying a
+// brick blanks only its own cells, and a frame copies the whole layer.
+// Restarting a level only clears the bitset and restores the layer.
+class BrickField
+{
+private:
+    std::vector<Brick> bricks;
+    std::vector<uint64_t> destroyedBits;
+    std::vector<uint64_t> powerBits;
+    std::vector<int> cells; // brick index per screen cell, -1 when empty
+    std::vector<CHAR_INFO> layer;
+    std::vector<CHAR_INFO> freshLayer; // layer with every brick standing
+    int cellsWidth = 0;
+    int cellsHeight = 0;
+    int remaining = 0;
+
+    void clear(int width, int height)
+    {
+        bricks.clear();
+        destroyedBits.clear();
+        powerBits.clear();
+        cellsWidth = width;
+        cellsHeight = height;
+        cells.assign((size_t)width * height, -1);
+        CHAR_INFO blank;
+        blank.Char.UnicodeChar = L' ';
+        blank.Attributes = 0;
+        layer.assign((size_t)width * height, blank);
+        remaining = 0;
+    }
+
+    // A brick whose cells are all taken already could never be hit, so it
+    // is skipped instead of blocking allDestroyed().
+    void add(int x, int y, int w, int h, bool power)
+    {
+        bool visible = false;
+        for (int cy = y; cy < y + h; cy++)
+        {
+            for (int cx = x; cx < x + w; cx++)
+            {
+                if (cx >= 0 && cx < cellsWidth && cy >= 0 && cy < cellsHeight && cells[cy * cellsWidth + cx] < 0)
+                    visible = true;
+            }
+        }
+        if (!visible)
+            return;
+
+        int index = (int)bricks.size();
+        bricks.emplace_back(x, y, w, h);
+        bricks.back().draw(layer.data(), cellsWidth, cellsHeight, power ? L'+' : L'.', power ? 6 : 7);
+        if (index % 64 == 0)
+        {
+            destroyedBits.push_back(0);
+            powerBits.push_back(0);
+        }
+        if (power)
+            powerBits[index / 64] |= uint64_t(1) << (index % 64);
+        remaining++;
+
+        for (int cy = y; cy < y + h; cy++)
+        {
+            for (int cx = x; cx < x + w; cx++)
+            {
+                if (cx >= 0 && cx < cellsWidth && cy >= 0 && cy < cellsHeight && cells[cy * cellsWidth + cx] < 0)
+                    cells[cy * cellsWidth + cx] = index;
+            }
+        }
+    }
+
+public:
+    void load(const LevelBrick records[], uint32_t count, int width, int height)
+    {
+        clear(width, height);
+        bricks.reserve(count);
+        for (uint32_t i = 0; i < count; i++)
+            add(records[i].x, records[i].y, records[i].w, records[i].h, records[i].power != 0);
+        freshLayer = layer;
+    }
+
+    void reset()
+    {
+        std::fill(destroyedBits.begin(), destroyedBits.end(), 0);
+        std::copy(freshLayer.begin(), freshLayer.end(), layer.begin());
+        remaining = (int)bricks.size();
+    }
+
+    bool isPower(int index) const
+    {
+        return (powerBits[index / 64] >> (index % 64)) & 1;
+    }
+
+    bool isDestroyed(int index) const
+    {
+        return (destroyedBits[index / 64] >> (index % 64)) & 1;
+    }
+
+    void destroy(int index)
+    {
+        if (isDestroyed(index))
+            return;
+        destroyedBits[index / 64] |= uint64_t(1) << (index % 64);
+        remaining--;
+        bricks[index].draw(layer.data(), cellsWidth, cellsHeight, L' ', 0);
+    }
+
+    // Lowest-index live brick overlapping rect, or -1.
+    int hitAt(const Rect &rect) const
+    {
+        int hit = -1;
+        for (int cy = std::max(rect.top(), 0); cy < std::min(rect.bottom(), cellsHeight); cy++)
+        {
+            for (int cx = std::max(rect.left(), 0); cx < std::min(rect.right(), cellsWidth); cx++)
+            {
+                int index = cells[cy * cellsWidth + cx];
+                if (index >= 0 && !isDestroyed(index) && (hit < 0 || index < hit))
+                    hit = index;
+            }
+        }
+        return hit;
+    }
+
+    bool allDestroyed() const
     {
-        if (!destroyed)
-            win.drawBox(pos.x, pos.y, width, height, ch, color, true);
+        return remaining == 0;
     }
 
-    void destroy()
+    int size() const
     {
-        destroyed = true;
+        return (int)bricks.size();
     }
 
-    bool isDestroyed() const
+    int getRemaining() const
     {
-        return destroyed;
+        return remaining;
+    }
+
+    // slow recount from the bitset, for invariant checks
+    int countLive() const
+    {
+        int live = 0;
+        for (int i = 0; i < size(); i++)
+            live += !isDestroyed(i);
+        return live;
+    }
+
+    // Starts a frame: replaces the whole window buffer with the layer.
+    void draw(Window &win)
+    {
+        win.drawLayer(layer.data(), cellsWidth, cellsHeight);
     }
 };
 
@@ -439,7 +905,7 @@ public:
         previousKeys = currentKeys; // Save previous state
 
         // List of keys you want to monitor
-        int keys[] = {VK_LEFT, VK_RIGHT, VK_SPACE, 'A', 'D', VK_ESCAPE};
+        int keys[] = {VK_LEFT, VK_RIGHT, VK_SPACE, 'A', 'D', 'P', VK_ESCAPE, VK_F3, VK_F4};
 
         for (int key : keys)
         {
@@ -470,233 +936,878 @@ public:
     }
 };
 
-bool checkXBound(Window &window, int bound)
-{
-    if (bound >= window.getWidth() || bound <= 0)
-        return true;
-    return false;
-}
-
-bool checkYBound(Window &window, int bound)
-{
-    if (bound >= window.getHeight() || bound <= 0)
-        return true;
-    return false;
-}
-
-class GameManager
+const int PHYSICS_HZ = 1000;
+const fixed BALL_SPEED = cellToFixed(20) / PHYSICS_HZ;   // 20 cells/s per axis
+const fixed PADDLE_SPEED = cellToFixed(60) / PHYSICS_HZ; // 60 cells/s
+const size_t MAX_BALLS = 1 << 20;
+
+// Balls, paddle and bricks advanced in fixed 1 ms steps, independent of how
+// often the game renders. Knows nothing about the console.
+//
+// Within a step every ball sees the bricks as they were when the step
+// began: hits are collected, all balls that touched a brick bounce, and the
+// bricks are removed afterwards. The outcome therefore does not depend on
+// the order in which balls are visited.
+class PhysicsWorld
 {
 private:
-    Window *_window;
-    Paddle *_paddle;
-    Ball ball;
-    std::vector<Brick> bricks;
-    InputHandler input;
-    int ball_x_dir, ball_y_dir;
-    int paddle_x_dir;
-    int speed;
-    bool ballDestroy;
+    struct BrickHit
+    {
+        int brick;
+        int ball;
+    };
+
+    int width, height;
+    int maxWidth, maxHeight; // the window; a bigger level is cropped to it
+    Paddle *paddle;
+    fixed paddleX;
+    BallSet balls;
+    BrickField bricks;
     int lives;
+    int respawnSteps; // > 0 while the last lost ball waits to come back
+    int lostX, lostY;
+    bool solidFloor;  // stress mode: the floor bounces instead of eating balls
+
+    std::vector<int> crossing;
+    std::vector<BrickHit> hits;
+    std::vector<int> lost;
 
-    void createBlockOfBricks()
+    void serveBall()
     {
-        bricks.erase(bricks.begin(), bricks.end());
+        balls.add(cellToFixed((width / 2) - 5) + FIXED_ONE / 2, cellToFixed(height / 2) + FIXED_ONE / 2,
+                  BALL_SPEED, BALL_SPEED);
+    }
+
+    void movePaddle(int dir)
+    {
+        paddleX += dir * PADDLE_SPEED;
+        paddleX = std::max<fixed>(0, std::min<fixed>(paddleX, cellToFixed(width - paddle->getWidth())));
+        paddle->setPosition(fixedToCell(paddleX), height - 1);
+    }
+
+    // Moves ball i along x into the next cell unless a wall or brick is in
+    // the way, in which case it reflects.
+    void sweepX(int i)
+    {
+        fixed dx = balls.vx[i];
+        int toCell = fixedToCell(balls.x[i] + dx);
+        if (toCell == balls.cellX(i))
+        {
+            balls.x[i] += dx;
+            return;
+        }
+
+        if (toCell < 0 || toCell >= width)
+        {
+            balls.vx[i] = -dx;
+            return;
+        }
+
+        int hit = bricks.hitAt({toCell, balls.cellY(i), 1, 1});
+        if (hit >= 0)
+        {
+            hits.push_back({hit, i});
+            balls.vx[i] = -dx;
+            return;
+        }
+
+        balls.x[i] += dx;
+    }
+
+    void sweepY(int i)
+    {
+        fixed dy = balls.vy[i];
+        int toCell = fixedToCell(balls.y[i] + dy);
+        if (toCell == balls.cellY(i))
+        {
+            balls.y[i] += dy;
+            return;
+        }
+
+        // row 0 holds the lives counter
+        if (toCell < 1)
+        {
+            balls.vy[i] = -dy;
+            return;
+        }
+
+        Rect paddleRect = paddle->getRect();
+        int cellX = balls.cellX(i);
+        if (dy > 0 && toCell == paddleRect.top() && cellX >= paddleRect.left() && cellX < paddleRect.right())
+        {
+            // the further from the centre, the flatter the bounce
+            fixed paddleCenter = paddleX + cellToFixed(paddle->getWidth()) / 2;
+            fixed halfWidth = cellToFixed(paddle->getWidth()) / 2;
+            int64_t diff = (int64_t)balls.x[i] - paddleCenter;
+            fixed vx = (fixed)(diff * BALL_SPEED / halfWidth);
+            balls.vx[i] = std::max(-BALL_SPEED, std::min(vx, BALL_SPEED));
+            balls.vy[i] = -BALL_SPEED;
+            return;
+        }
+
+        if (toCell >= height)
+        {
+            if (solidFloor)
+                balls.vy[i] = -dy;
+            else
+                lost.push_back(i);
+            return;
+        }
 
-        // Create a grid of bricks
-        int brickRows = 13;
-        int brickCols = 50;
-        int brickW = 1;
-        int brickH = 1;
-        for (int row = 0; row < brickRows; row++)
+        int hit = bricks.hitAt({cellX, toCell, 1, 1});
+        if (hit >= 0)
         {
-            for (int col = 0; col < brickCols; col++)
+            hits.push_back({hit, i});
+            balls.vy[i] = -dy;
+            return;
+        }
+
+        balls.y[i] += dy;
+    }
+
+    void applyHits()
+    {
+        // hits are in ball order, so the first ball to break a power brick
+        // is always the lowest index
+        for (const BrickHit &hit : hits)
+        {
+            if (bricks.isDestroyed(hit.brick))
+                continue;
+            bricks.destroy(hit.brick);
+
+            if (bricks.isPower(hit.brick) && balls.size() + 2 <= MAX_BALLS)
             {
-                int x = col * (brickW) + (_window->getWidth() - brickCols) / 2;
-                int y = row * (brickH) + 2;
-                bricks.emplace_back(x, y, brickW, brickH);
+                fixed bx = balls.x[hit.ball];
+                fixed by = balls.y[hit.ball];
+                fixed bvx = balls.vx[hit.ball];
+                fixed bvy = balls.vy[hit.ball];
+                // a vertical ball would split into three stacked copies
+                fixed spread = bvx != 0 ? bvx : BALL_SPEED;
+                balls.add(bx, by, -spread, bvy);
+                balls.add(bx, by, spread / 2, bvy);
             }
         }
+        hits.clear();
     }
-    void createCircleOfBricks()
+
+    void removeLost()
     {
-        int centerX = _window->getWidth() / 2;
-        int centerY = 5;
-        int radius = 5;      // distance from center
-        int brickCount = 60; // number of bricks in the circle
-        int brickW = 1;
-        int brickH = 1;
+        // highest index first so swap-removal never moves a ball still in the list
+        std::sort(lost.begin(), lost.end());
+        for (size_t k = lost.size(); k-- > 0;)
+        {
+            lostX = balls.cellX(lost[k]);
+            lostY = height - 1;
+            balls.remove(lost[k]);
+        }
+        lost.clear();
 
-        for (int i = 0; i < brickCount; ++i)
+        if (balls.size() == 0)
         {
-            float angle = (2.0f * 3.14159f * i) / brickCount; // convert index to angle in radians
+            lives--;
+            respawnSteps = PHYSICS_HZ / 2;
+        }
+    }
 
-            int x = static_cast<int>(centerX + radius * std::cos(angle));
-            int y = static_cast<int>(centerY + radius * sin(angle));
+public:
+    PhysicsWorld(Paddle *_paddle, int _width, int _height)
+        : width(_width), height(_height), maxWidth(_width), maxHeight(_height), paddle(_paddle), paddleX(0),
+          lives(0), respawnSteps(0),
+          lostX(0), lostY(0), solidFloor(false)
+    {
+    }
 
-            bricks.emplace_back(x, y, brickW, brickH);
-        }
+    // The play area takes the level's size, up to the window's. Bricks
+    // outside it are dropped when the level loads.
+    void loadLevel(const LevelView &level)
+    {
+        width = std::min<int>(level.header->width, maxWidth);
+        height = std::min<int>(level.header->height, maxHeight);
+        bricks.load(level.bricks, level.header->brickCount, width, height);
+    }
+
+    // Same level again: clears the destroyed bitset, nothing is rebuilt.
+    void restartLevel()
+    {
+        bricks.reset();
+        start();
     }
 
     void start()
     {
-        ball_x_dir = 1, ball_y_dir = 1;
-        paddle_x_dir = 1;
-        speed = 3;
         lives = 3;
-        _paddle->setPosition(_window->getWidth() / 2, _window->getHeight() - 1);
-        ball.setPosition((_window->getWidth() / 2) - 5, _window->getHeight() / 2);
+        respawnSteps = 0;
+        solidFloor = false;
+        paddleX = cellToFixed(width / 2);
+        movePaddle(0);
+        balls.clear();
+        serveBall();
     }
 
-public:
-    GameManager(Window *window, Paddle *paddle)
+    // Stress mode: count balls spread over the lower half, and a floor that
+    // bounces so the count stays fixed.
+    void startStress(int count, unsigned seed)
     {
-        _window = window;
-        _paddle = paddle;
-        createBlockOfBricks();
+        start();
+        solidFloor = true;
+        balls.clear();
+        srand(seed);
+        for (int i = 0; i < count && balls.size() < MAX_BALLS; i++)
+        {
+            fixed x = cellToFixed(rand() % width) + rand() % FIXED_ONE;
+            fixed y = cellToFixed(height / 2 + rand() % (height / 2 - 1)) + rand() % FIXED_ONE;
+            balls.add(x, y, (rand() % 2) ? BALL_SPEED : -BALL_SPEED, -BALL_SPEED);
+        }
     }
 
-    ~GameManager()
+    // One physics step. paddleDir is -1, 0 or 1.
+    void step(int paddleDir)
     {
-        delete _window;
-        delete _paddle;
+        if (isOver())
+            return;
+
+        movePaddle(paddleDir);
+
+        if (respawnSteps > 0)
+        {
+            if (--respawnSteps == 0)
+                serveBall();
+            return;
+        }
+
+        // velocities stay under one cell per step, so a ball enters at most
+        // one new cell per axis and only those balls need the world
+        crossing.clear();
+        balls.integrate(crossing);
+        for (int i : crossing)
+        {
+            sweepX(i);
+            sweepY(i);
+        }
+
+        applyHits();
+        if (!lost.empty())
+            removeLost();
     }
 
-    void gameLoop()
+    bool isOver() const
     {
-        start();
-        while (true)
+        return lives <= 0 || bricks.allDestroyed();
+    }
+
+    bool isBallLost() const
+    {
+        return respawnSteps > 0 || lives <= 0;
+    }
+
+    int getLives() const
+    {
+        return lives;
+    }
+
+    int getLostX() const { return lostX; }
+    int getLostY() const { return lostY; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    const BallSet &getBalls() const
+    {
+        return balls;
+    }
+
+    BrickField &getBricks()
+    {
+        return bricks;
+    }
+
+    const BrickField &getBricks() const
+    {
+        return bricks;
+    }
+
+    // Returns the number of broken invariants and describes the first one.
+    // The brick recount is O(bricks), so callers run it only now and then.
+    int checkInvariants(bool recountBricks, std::string *firstProblem = nullptr) const
+    {
+        int problems = 0;
+        auto report = [&](const std::string &what)
+        {
+            if (problems++ == 0 && firstProblem != nullptr)
+                *firstProblem = what;
+        };
+
+        if (lives < 0 || lives > 3)
+            report("lives out of range");
+        if (balls.size() > MAX_BALLS)
+            report("too many balls");
+        if (paddle->getX() < 0 || paddle->getX() + paddle->getWidth() > width)
+            report("paddle outside the play area");
+        if (bricks.getRemaining() < 0 || bricks.getRemaining() > bricks.size())
+            report("live brick counter out of range");
+        if (recountBricks && bricks.countLive() != bricks.getRemaining())
+            report("live brick counter disagrees with the bitset");
+
+        for (size_t i = 0; i < balls.size(); i++)
         {
-            int timer = 50;
-            ballDestroy = false;
-            input.update();
+            int cx = balls.cellX(i);
+            int cy = balls.cellY(i);
+            if (cx < 0 || cx >= width || cy < 1 || cy >= height)
+                report("ball outside the play area");
+            else if (bricks.hitAt({cx, cy, 1, 1}) >= 0)
+                report("ball inside a live brick");
+            if (balls.vy[i] == 0)
+                report("ball with no vertical speed");
+            if (std::abs(balls.vx[i]) >= FIXED_ONE || std::abs(balls.vy[i]) >= FIXED_ONE)
+                report("ball faster than one cell per step");
+        }
+        return problems;
+    }
+};
 
-            bool collidedLeft = checkXBound(*_window, _paddle->getRect().left());
-            bool collidedRight = checkXBound(*_window, _paddle->getRect().right());
+// Moves the paddle under the point where the next falling ball will reach
+// the paddle row. Side-wall bounces are unfolded; bricks are ignored since
+// the paddle row is far below them. Each ball gets a small random aim
+// offset so returns are not all vertical.
+class Autopilot
+{
+private:
+    unsigned rng;
+    int aimOffset; // in cells from the paddle centre
+    int lastChosen; // the ball aimed for last step, -1 for none
+    int lastVy;
 
-            ////////////// control
-            if (lives > 0)
-            {
-                if (input.isKeyDown('D') && !collidedRight)
-                {
-                    paddle_x_dir = 1;
-                    _paddle->move(paddle_x_dir * speed, 0);
-                }
-                else if (input.isKeyDown('A') && !collidedLeft)
-                {
-                    paddle_x_dir = -1;
-                    _paddle->move(paddle_x_dir * speed, 0);
-                }
-            }
-            ///////////////////////////////////////////////////////
+    int nextRandom()
+    {
+        rng = rng * 1103515245u + 12345u;
+        return (int)((rng >> 16) & 0x7fff);
+    }
+
+public:
+    Autopilot(unsigned seed = 1) : rng(seed), aimOffset(0), lastChosen(-1), lastVy(0) {}
+
+    int predictLandingX(const PhysicsWorld &world, size_t i) const
+    {
+        const BallSet &balls = world.getBalls();
+        int64_t span = (int64_t)cellToFixed(world.getWidth());
+        int64_t distance = (int64_t)cellToFixed(world.getHeight() - 1) - balls.y[i];
+        int64_t steps = distance / balls.vy[i];
+        int64_t x = balls.x[i] + balls.vx[i] * steps;
+
+        // fold the straight path back into [0, span)
+        x %= 2 * span;
+        if (x < 0)
+            x += 2 * span;
+        if (x >= span)
+            x = 2 * span - 1 - x;
+        return fixedToCell((fixed)x);
+    }
+
+    // -1, 0 or 1 for PhysicsWorld::step
+    int decide(const PhysicsWorld &world, const Paddle &paddle)
+    {
+        const BallSet &balls = world.getBalls();
 
-            ////////////// collision detection
-            if (checkXBound(*_window, ball.getRect().left()) || checkXBound(*_window, ball.getRect().left()))
+        // the falling ball that reaches the paddle row first
+        int chosen = -1;
+        int64_t soonest = 0;
+        for (size_t i = 0; i < balls.size(); i++)
+        {
+            if (balls.vy[i] <= 0)
+                continue;
+            int64_t steps = ((int64_t)cellToFixed(world.getHeight() - 1) - balls.y[i]) / balls.vy[i];
+            if (chosen < 0 || steps < soonest)
             {
-                ball_x_dir *= -1;
+                chosen = (int)i;
+                soonest = steps;
             }
+        }
+
+        if (chosen < 0)
+        {
+            lastChosen = -1;
+            lastVy = -1;
+            return 0;
+        }
 
-            Rect nextBallRect = ball.getRect();
-            nextBallRect._x += ball_x_dir;
-            nextBallRect._y += ball_y_dir;
+        // a new ball to catch, or the same one falling again after a
+        // bounce: pick a new aim point
+        if (chosen != lastChosen || lastVy <= 0)
+            aimOffset = nextRandom() % 7 - 3;
+        lastChosen = chosen;
+        lastVy = balls.vy[chosen];
 
-            if (checkYBound(*_window, ball.getRect().top()))
+        int target = predictLandingX(world, chosen) - aimOffset;
+        int paddleCenter = paddle.getX() + paddle.getWidth() / 2;
+        return (target > paddleCenter) - (target < paddleCenter);
+    }
+};
+
+class GameManager
+{
+private:
+    Window *_window;
+    Paddle *_paddle;
+    PhysicsWorld world;
+    InputHandler input;
+    int stressBalls;
+    std::vector<Level> builtInLevels;
+    std::vector<LevelFile *> levelFiles; // kept mapped so switching levels never reads the disk
+    std::vector<LevelView> levels;
+    int currentLevel;
+    Autopilot autopilot;
+    bool autopilotOn;
+
+    static const int FRAME_MS = 16;
+    static const int MAX_STEPS_PER_FRAME = 250; // drop time rather than spiral after a stall
+
+    void restart()
+    {
+        if (stressBalls > 0)
+        {
+            world.getBricks().reset();
+            world.startStress(stressBalls, 1);
+        }
+        else
+        {
+            world.restartLevel();
+        }
+    }
+
+    void nextLevel()
+    {
+        currentLevel = (currentLevel + 1) % (int)levels.size();
+        world.loadLevel(levels[currentLevel]);
+        restart();
+    }
+
+public:
+    GameManager(Window *window, Paddle *paddle, const std::vector<std::string> &levelPaths, int _stressBalls = 0)
+        : _window(window), _paddle(paddle), world(paddle, window->getWidth(), window->getHeight()),
+          stressBalls(_stressBalls), currentLevel(0), autopilotOn(false)
+    {
+        for (const std::string &path : levelPaths)
+        {
+            LevelFile *file = new LevelFile;
+            if (file->open(path))
             {
-                ball_y_dir *= -1;
+                levelFiles.push_back(file);
+                levels.push_back(file->view());
             }
-
-            if (nextBallRect.intersects(_paddle->getRect()))
+            else
             {
-                ball_y_dir *= -1;
+                delete file;
+            }
+        }
 
-                // Determine reflection direction
-                int ballCenterX = ball.getX();
-                int paddleCenter = _paddle->getX() + _paddle->getWidth() / 2;
-                int diff = ballCenterX - paddleCenter;
+        if (levels.empty())
+        {
+            builtInLevels.push_back(makeBlockLevel(window->getWidth(), window->getHeight()));
+            builtInLevels.push_back(makeCircleLevel(window->getWidth(), window->getHeight()));
+            for (const Level &level : builtInLevels)
+                levels.push_back(level.view());
+        }
 
-                if (diff < 0)
-                    ball_x_dir = -1; // Bounce left
-                else if (diff > 0)
-                    ball_x_dir = 1; // Bounce right
-                else
-                    ball_x_dir = 0; // Go straight up
-            }
-            else if (checkYBound(*_window, ball.getRect().bottom()))
+        world.loadLevel(levels[currentLevel]);
+    }
+
+    ~GameManager()
+    {
+        for (auto file : levelFiles)
+            delete file;
+    }
+
+    void gameLoop()
+    {
+        restart();
+        auto previous = std::chrono::steady_clock::now();
+        double accumulator = 0.0;
+        const double stepSeconds = 1.0 / PHYSICS_HZ;
+
+        while (true)
+        {
+            auto now = std::chrono::steady_clock::now();
+            accumulator += std::chrono::duration<double>(now - previous).count();
+            previous = now;
+
+            ////////////// control
+            int paddleDir = 0;
             {
-                ballDestroy = true;
-                lives--;
+                PROFILE_SCOPE(PHASE_INPUT);
+                input.update();
+                if (input.isKeyPressed(VK_ESCAPE))
+                    break;
+                if (input.isKeyPressed('P'))
+                    autopilotOn = !autopilotOn;
+                if (input.isKeyPressed(VK_F3))
+                    Profiler::toggle();
+                if (input.isKeyPressed(VK_F4))
+                    Trace::write();
+
+                if (input.isKeyDown('D'))
+                    paddleDir = 1;
+                else if (input.isKeyDown('A'))
+                    paddleDir = -1;
             }
+            ///////////////////////////////////////////////////////
 
-            // brick collision
-            for (auto &brick : bricks)
+            ////////////// physics
+            // collisions are resolved inside each step, so they are timed
+            // as part of the update
             {
-                if (!brick.isDestroyed() && ball.getRect().intersects(brick.getRect()))
+                PROFILE_SCOPE(PHASE_UPDATE);
+                int steps = 0;
+                while (accumulator >= stepSeconds && steps < MAX_STEPS_PER_FRAME)
                 {
-                    brick.destroy();
-                    ball_y_dir *= -1;
-                    break;
+                    world.step(autopilotOn ? autopilot.decide(world, *_paddle) : paddleDir);
+                    accumulator -= stepSeconds;
+                    steps++;
                 }
+                if (steps == MAX_STEPS_PER_FRAME)
+                    accumulator = 0.0;
+                TRACE_COUNTER("physics steps", steps);
             }
             ///////////////////////////////////////////////////////
 
             ////////////// game logic
-            if (lives <= 0)
             {
-                _window->drawChar(ball.getX(), ball.getY(), L'X');
-                std::wstring text = L"Game Over Press Space to play again";
-                _window->drawText((_window->getWidth() - text.length()) / 2, _window->getHeight() / 2, text, 4);
-                if (input.isKeyPressed(VK_SPACE))
+                PROFILE_SCOPE(PHASE_DRAW);
+                // the brick layer doubles as this frame's clear
+                world.getBricks().draw(*_window);
+
+                const BallSet &balls = world.getBalls();
+                if (world.getLives() <= 0)
                 {
-                    start();
-                    createBlockOfBricks();
+                    _window->drawChar(world.getLostX(), world.getLostY(), L'X');
+                    std::wstring text = L"Game Over Press Space to play again";
+                    _window->drawText((_window->getWidth() - text.length()) / 2, _window->getHeight() / 2, text, 4);
+                    if (input.isKeyPressed(VK_SPACE))
+                        restart();
                 }
-            }
-            else if (bricks.empty())
-            {
-                std::wstring text = L"You won Press Space to play again";
-                _window->drawText((_window->getWidth() - text.length()) / 2, _window->getHeight() / 2, text, 2);
-                if (input.isKeyPressed(VK_SPACE))
+                else if (world.getBricks().allDestroyed())
                 {
-                    start();
-                    createBlockOfBricks();
+                    std::wstring text = L"You won Press Space for the next level";
+                    _window->drawText((_window->getWidth() - text.length()) / 2, _window->getHeight() / 2, text, 2);
+                    if (input.isKeyPressed(VK_SPACE))
+                        nextLevel();
                 }
-            }
-            else if (!ballDestroy)
-            {
-                _window->drawChar(ball.getX(), ball.getY(), L'O');
-                ball.move(ball_x_dir, ball_y_dir);
+                else if (world.isBallLost())
+                {
+                    _window->drawChar(world.getLostX(), world.getLostY(), L'X');
+                }
+                else
+                {
+                    for (size_t i = 0; i < balls.size(); i++)
+                        _window->drawChar(balls.cellX(i), balls.cellY(i), balls.shape);
+                }
+                ///////////////////////////////////////////////////////
+
+                ////////////// rendering
+                std::wstring lives_bar = L"Lives: ";
+                lives_bar += std::to_wstring(world.getLives());
+                if (balls.size() > 1)
+                    lives_bar += L"  Balls: " + std::to_wstring(balls.size());
+                _window->drawText(0, 0, lives_bar);
+
+                _window->drawObject(_paddle->getShape(), _paddle->getWidth(), _paddle->getHeight(), _paddle->getX(), _paddle->getY(), L'=');
+                drawProfilerOverlay(*_window, 0, 1);
             }
             ///////////////////////////////////////////////////////
 
-            ////////////// rendering
-            std::wstring lives_bar = L"Lives: ";
-            lives_bar += std::to_wstring(lives);
-            _window->drawText(0, 0, lives_bar);
-            for (auto &brick : bricks)
             {
-                brick.draw(*_window);
+                PROFILE_SCOPE(PHASE_PRESENT);
+                _window->render(false);
+                _window->updateSizeIfChanged();
             }
-
-            if (ballDestroy)
             {
-                _window->drawChar(ball.getX(), ball.getY(), L'X');
-                ball.setPosition((_window->getWidth() / 2) - 5, _window->getHeight() / 2);
-                timer = 500;
+                PROFILE_SCOPE(PHASE_SLEEP);
+                Sleep(FRAME_MS);
             }
-            
-            _window->drawObject(_paddle->getShape(), _paddle->getWidth(), _paddle->getHeight(), _paddle->getX(), _paddle->getY(), L'=');
-            _window->render();
-            _window->updateSizeIfChanged();
-            ///////////////////////////////////////////////////////
-            Sleep(timer);
+            Profiler::collect();
+            TRACE_COUNTER("balls", world.getBalls().size());
         }
+        Trace::write();
     }
 };
 
-int main()
+// Runs the physics with no console and no sleeping. The paddle tracks the
+// first ball with a random offset so bounces do not settle into a vertical
+// loop; a finished game restarts.
+void benchmarkPhysics(long long steps)
+{
+    Paddle paddle(10, 1);
+    PhysicsWorld world(&paddle, 120, 30);
+    Level level = makeBlockLevel(120, 30);
+    world.loadLevel(level.view());
+    world.start();
+    int games = 0;
+    int offset = 0;
+    srand(1);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (long long i = 0; i < steps; i++)
+    {
+        if (world.isOver())
+        {
+            games++;
+            world.restartLevel();
+        }
+
+        const BallSet &balls = world.getBalls();
+        int target = paddle.getX() + paddle.getWidth() / 2;
+        if (balls.size() > 0)
+        {
+            if (balls.vy[0] < 0)
+                offset = rand() % 7 - 3;
+            target = balls.cellX(0) + offset;
+        }
+        int paddleCenter = paddle.getX() + paddle.getWidth() / 2;
+        int dir = (target > paddleCenter) - (target < paddleCenter);
+        world.step(dir);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    std::cout << "steps: " << steps << " (" << steps / PHYSICS_HZ << " simulated s)\n";
+    std::cout << "games finished: " << games << "\n";
+    std::cout << "wall s: " << elapsed.count() << "\n";
+    std::cout << "steps/s: " << (long long)(steps / elapsed.count()) << "\n";
+    std::cout << "realtime factor: " << (steps / (double)PHYSICS_HZ) / elapsed.count() << "x\n";
+}
+
+// Physics cost of one 60 fps frame against ball count, in stress mode.
+void benchmarkBalls(int maxBalls)
+{
+    const int stepsPerFrame = PHYSICS_HZ / 60;
+    const int frames = 120;
+
+    Level level = makeBlockLevel(120, 30);
+
+    std::cout << "balls\tms/frame\tsteps/s\n";
+    for (int count = 1; count <= maxBalls; count *= 10)
+    {
+        Paddle paddle(10, 1);
+        PhysicsWorld world(&paddle, 120, 30);
+        world.loadLevel(level.view());
+        world.startStress(count, 1);
+
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames * stepsPerFrame; i++)
+        {
+            if (world.getBricks().allDestroyed())
+                world.getBricks().reset();
+            world.step(0);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+        std::cout << count << "\t" << elapsed.count() * 1000.0 / frames << "\t"
+                  << (long long)(frames * stepsPerFrame / elapsed.count()) << "\n";
+    }
+}
+
+// Plays seeded autopilot games on every core with no sleeping. Each game
+// runs for a fixed simulated time, restarting its level whenever it is
+// cleared or lost, and checks the world invariants as it goes. Returns the
+// number of violations, or -1 when there is nothing to run.
+long long runSoak(int games, int simulatedSeconds, unsigned threadCount)
+{
+    if (games <= 0 || simulatedSeconds <= 0)
+    {
+        std::cout << "games and simulated seconds must be positive\n";
+        return -1;
+    }
+
+    const int stepsPerFrame = PHYSICS_HZ / 60;
+    const long long stepsPerGame = (long long)simulatedSeconds * PHYSICS_HZ;
+    Level level = makeBlockLevel(120, 30);
+
+    std::atomic<int> nextGame(0);
+    std::atomic<long long> totalSteps(0);
+    std::atomic<long long> levelsCleared(0);
+    std::atomic<long long> livesLost(0);
+    std::atomic<long long> violations(0);
+    std::string firstProblem;
+    std::atomic<bool> problemRecorded(false);
+
+    auto worker = [&]()
+    {
+        int game;
+        while ((game = nextGame.fetch_add(1)) < games)
+        {
+            Paddle paddle(10, 1);
+            PhysicsWorld world(&paddle, 120, 30);
+            Autopilot autopilot(1000 + game);
+            world.loadLevel(level.view());
+            world.start();
+            int lives = world.getLives();
+
+            for (long long step = 0; step < stepsPerGame; step++)
+            {
+                if (world.isOver())
+                {
+                    if (world.getBricks().allDestroyed())
+                        levelsCleared++;
+                    world.restartLevel();
+                    lives = world.getLives();
+                }
+
+                world.step(autopilot.decide(world, paddle));
+
+                if (world.getLives() < lives)
+                {
+                    livesLost += lives - world.getLives();
+                    lives = world.getLives();
+                }
+
+                if (step % stepsPerFrame == 0)
+                {
+                    // the brick recount is slow, so only once a simulated second
+                    long long frame = step / stepsPerFrame;
+                    std::string problem;
+                    int found = world.checkInvariants(frame % 60 == 0, &problem);
+                    if (found > 0)
+                    {
+                        violations += found;
+                        if (!problemRecorded.exchange(true))
+                            firstProblem = "game " + std::to_string(game) + " step " + std::to_string(step) + ": " + problem;
+                    }
+                }
+            }
+            totalSteps += stepsPerGame;
+        }
+    };
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < threadCount; t++)
+        threads.emplace_back(worker);
+    worker();
+    for (auto &t : threads)
+        t.join();
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    double simulatedMinutes = totalSteps / (double)PHYSICS_HZ / 60.0;
+    std::cout << "games: " << games << " x " << simulatedSeconds << " simulated s on " << threadCount << " threads\n";
+    std::cout << "wall s: " << wall << "\n";
+    std::cout << "simulated frames/s: " << (long long)(totalSteps / stepsPerFrame / wall) << "\n";
+    std::cout << "levels cleared per simulated minute: " << levelsCleared / simulatedMinutes << "\n";
+    std::cout << "lives lost per simulated minute: " << livesLost / simulatedMinutes << "\n";
+    std::cout << "invariant violations: " << violations << "\n";
+    if (violations > 0)
+        std::cout << "first: " << firstProblem << "\n";
+    return violations;
+}
+
+// Times mapping and loading a level file and restarting it.
+void benchmarkLevel(const std::string &path)
+{
+    Paddle paddle(10, 1);
+    LevelFile file;
+
+    auto begin = std::chrono::steady_clock::now();
+    if (!file.open(path))
+    {
+        std::cout << "cannot open level " << path << "\n";
+        return;
+    }
+    auto mapped = std::chrono::steady_clock::now();
+    // sized to the level so no brick is cropped away
+    PhysicsWorld world(&paddle, file.view().header->width, file.view().header->height);
+    world.loadLevel(file.view());
+    auto loaded = std::chrono::steady_clock::now();
+
+    const int restarts = 100;
+    for (int i = 0; i < restarts; i++)
+        world.restartLevel();
+    auto restarted = std::chrono::steady_clock::now();
+
+    std::cout << "bricks: " << world.getBricks().size() << "\n";
+    std::cout << "map ms: " << std::chrono::duration<double, std::milli>(mapped - begin).count() << "\n";
+    std::cout << "load ms: " << std::chrono::duration<double, std::milli>(loaded - mapped).count() << "\n";
+    std::cout << "restart ms: " << std::chrono::duration<double, std::milli>(restarted - loaded).count() / restarts << "\n";
+}
+
+// Times an empty traced span and an empty profiled scope, which is what
+// each one adds to a frame. Near nothing when the build compiles them out.
+void benchmarkTrace(int scopes)
 {
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < scopes; i++)
+    {
+        TRACE_SCOPE("bench");
+    }
+    auto traced = std::chrono::steady_clock::now();
+    for (int i = 0; i < scopes; i++)
+    {
+        PROFILE_SCOPE(PHASE_UPDATE);
+    }
+    auto profiled = std::chrono::steady_clock::now();
+
+    std::cout << "scopes: " << scopes << "\n";
+    std::cout << "ns per TRACE_SCOPE: " << std::chrono::duration<double, std::nano>(traced - begin).count() / scopes << "\n";
+    std::cout << "ns per PROFILE_SCOPE: " << std::chrono::duration<double, std::nano>(profiled - traced).count() / scopes << "\n";
+}
+
+int main(int argc, char *argv[])
+{
+    // arkanoid [level files...]
+    // arkanoid --make-level file [cols] [rows]
+    // arkanoid --bench-level file
+    // arkanoid --soak [games] [simulated seconds] [threads]
+    if (argc > 1 && std::string(argv[1]) == "--soak")
+    {
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        long long violations = runSoak(argc > 2 ? std::atoi(argv[2]) : 64,
+                                       argc > 3 ? std::atoi(argv[3]) : 3600,
+                                       argc > 4 ? (unsigned)std::atoi(argv[4]) : cores);
+        return violations != 0 ? 1 : 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--make-level")
+    {
+        int cols = argc > 3 ? std::atoi(argv[3]) : 50;
+        int rows = argc > 4 ? std::atoi(argv[4]) : 13;
+        if (cols <= 0 || rows <= 0 || !levelSizeOk(cols + 20LL, rows + 20LL))
+        {
+            std::cout << "cols and rows must be positive, and the level (cols + 20 by rows + 20) at most 65535 a side and "
+                      << LEVEL_MAX_CELLS << " cells\n";
+            return 1;
+        }
+        Level level = makeBlockLevel(cols + 20, rows + 20, cols, rows);
+        return level.save(argv[2]) ? 0 : 1;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--bench-level")
+    {
+        benchmarkLevel(argv[2]);
+        return 0;
+    }
+
+    // arkanoid --bench-physics [steps]
+    // arkanoid --bench-balls [max balls]
+    // arkanoid --bench-trace [scopes]
+    // arkanoid --stress [balls]
+    if (argc > 1 && std::string(argv[1]) == "--bench-physics")
+    {
+        benchmarkPhysics(argc > 2 ? std::atoll(argv[2]) : 10000000);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-balls")
+    {
+        benchmarkBalls(argc > 2 ? std::atoi(argv[2]) : 100000);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-trace")
+    {
+        benchmarkTrace(std::max(1, argc > 2 ? std::atoi(argv[2]) : 1000000));
+        return 0;
+    }
+    int stressBalls = 0;
+    std::vector<std::string> levelPaths;
+    if (argc > 1 && std::string(argv[1]) == "--stress")
+        stressBalls = argc > 2 ? std::atoi(argv[2]) : 1000;
+    else
+        levelPaths.assign(argv + 1, argv + argc);
+
     Window window(120, 30, 16);
     Paddle paddle(10, 1);
-    GameManager arkanoid(&window, &paddle);
+    GameManager arkanoid(&window, &paddle, levelPaths, stressBalls);
     arkanoid.gameLoop();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+// Per-frame timings for Circles. Samples go into a fixed ring that one
+// thread writes and any thread can read without locking; the summary and
+// the CSV dump are built from a copy of it. Slots are stored as relaxed
+// atomic words so a reader racing the writer gets a stale sample, never a
+// torn one it keeps.
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <atomic>
+
+struct FrameSample
+{
+    float frameMs;     // the whole frame, from its physics to the end of display
+    float simMs;       // all physics steps in the frame
+    float collisionMs; // the grid part of those steps
+    float renderMs;    // vertex build and draw, not the wait for display
+    uint32_t balls;
+};
+
+struct FrameSummary
+{
+    int frames = 0;
+    float fps = 0;
+    float p50 = 0;
+    float p99 = 0;
+    float max = 0;
+    float simMs = 0; // means over the same frames
+    float collisionMs = 0;
+    float renderMs = 0;
+};
+
+class FrameStats
+{
+private:
+    static const uint64_t CAPACITY = 1 << 16; // about six minutes at 180 fps
+    static const int WORDS = sizeof(FrameSample) / 4;
+
+    struct Slot
+    {
+        std::atomic<uint32_t> words[WORDS];
+    };
+
+    std::vector<Slot> ring;
+    std::atomic<uint64_t> written{0};
+
+    FrameSample load(uint64_t i) const
+    {
+        uint32_t words[WORDS];
+        const Slot &slot = ring[i & (CAPACITY - 1)];
+        for (int w = 0; w < WORDS; w++)
+            words[w] = slot.words[w].load(std::memory_order_relaxed);
+        FrameSample sample;
+        std::memcpy(&sample, words, sizeof(sample));
+        return sample;
+    }
+
+public:
+    FrameStats() : ring(CAPACITY)
+    {
+    }
+
+    // writer side, one thread only
+    void push(const FrameSample &sample)
+    {
+        uint64_t n = written.load(std::memory_order_relaxed);
+        uint32_t words[WORDS];
+        std::memcpy(words, &sample, sizeof(sample));
+        Slot &slot = ring[n & (CAPACITY - 1)];
+        for (int w = 0; w < WORDS; w++)
+            slot.words[w].store(words[w], std::memory_order_relaxed);
+        written.store(n + 1, std::memory_order_release);
+    }
+
+    uint64_t total() const
+    {
+        return written.load(std::memory_order_acquire);
+    }
+
+    // the newest samples, oldest first; any the writer may have lapped
+    // while copying are dropped
+    std::vector<FrameSample> recent(uint64_t count = CAPACITY) const
+    {
+        uint64_t end = written.load(std::memory_order_acquire);
+        uint64_t begin = end - std::min({count, end, CAPACITY});
+        std::vector<FrameSample> out;
+        out.reserve((size_t)(end - begin));
+        for (uint64_t i = begin; i < end; i++)
+            out.push_back(load(i));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = written.load(std::memory_order_relaxed);
+        // the writer may be part way into slot `after` too
+        if (after - begin >= CAPACITY)
+            out.erase(out.begin(), out.begin() + (size_t)std::min<uint64_t>(after - begin - CAPACITY + 1, out.size()));
+        return out;
+    }
+
+    FrameSummary summarize(uint64_t count) const
+    {
+        FrameSummary s;
+        std::vector<FrameSample> samples = recent(count);
+        if (samples.empty())
+            return s;
+
+        std::vector<float> times;
+        times.reserve(samples.size());
+        double total = 0;
+        for (const FrameSample &f : samples)
+        {
+            times.push_back(f.frameMs);
+            total += f.frameMs;
+            s.simMs += f.simMs;
+            s.collisionMs += f.collisionMs;
+            s.renderMs += f.renderMs;
+        }
+
+        s.frames = (int)samples.size();
+        s.fps = total > 0 ? (float)(s.frames * 1000 / total) : 0;
+        s.simMs /= s.frames;
+        s.collisionMs /= s.frames;
+        s.renderMs /= s.frames;
+
+        size_t mid = times.size() / 2;
+        std::nth_element(times.begin(), times.begin() + mid, times.end());
+        s.p50 = times[mid];
+        size_t tail = std::min(times.size() - 1, times.size() * 99 / 100);
+        std::nth_element(times.begin(), times.begin() + tail, times.end());
+        s.p99 = times[tail];
+        s.max = *std::max_element(times.begin() + tail, times.end());
+        return s;
+    }
+
+    bool writeCSV(const std::string &path) const
+    {
+        FILE *file = std::fopen(path.c_str(), "w");
+        if (!file)
+            return false;
+        std::vector<FrameSample> samples = recent();
+        uint64_t first = total() - samples.size();
+        std::fprintf(file, "frame,frame_ms,sim_ms,collision_ms,render_ms,balls\n");
+        for (size_t i = 0; i < samples.size(); i++)
+        {
+            const FrameSample &f = samples[i];
+            std::fprintf(file, "%llu,%.4f,%.4f,%.4f,%.4f,%u\n", (unsigned long long)(first + i), f.frameMs, f.simMs,
+                         f.collisionMs, f.renderMs, f.balls);
+        }
+        std::fclose(file);
+        return true;
+    }
+};
@@ -0,0 +1,482 @@
+#pragma once
+
+// Circles simulation core. Nothing in here touches SFML, so it can be
+// stepped and benchmarked without a window.
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <functional>
+#include <chrono>
+
+// the pool is shared with the console games; Circles writes no traces
+#ifndef ENGINE_TRACE
+#define ENGINE_TRACE 0
+#endif
+#include "../SpaceShooter/ConsoleGameEnigne/WorkerPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CIRCLES_SSE2
+#include <emmintrin.h>
+#endif
+
+// Ball state as parallel arrays, one entry per ball. Positions are centres
+// and colours are packed 0xRRGGBBAA.
+struct Particles
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> vx;
+    std::vector<float> vy;
+    std::vector<float> radius;
+    std::vector<uint32_t> color;
+
+    size_t size() const
+    {
+        return x.size();
+    }
+
+    void reserve(size_t count)
+    {
+        x.reserve(count);
+        y.reserve(count);
+        vx.reserve(count);
+        vy.reserve(count);
+        radius.reserve(count);
+        color.reserve(count);
+    }
+
+    void clear()
+    {
+        x.clear();
+        y.clear();
+        vx.clear();
+        vy.clear();
+        radius.clear();
+        color.clear();
+    }
+
+    void add(float px, float py, float velX, float velY, float r, uint32_t rgba)
+    {
+        x.push_back(px);
+        y.push_back(py);
+        vx.push_back(velX);
+        vy.push_back(velY);
+        radius.push_back(r);
+        color.push_back(rgba);
+    }
+};
+
+// One axis of the edge bounce: a ball touching either wall has its velocity
+// flipped, then every ball moves. The SSE2 path flips the sign bit, which is
+// exactly what the scalar negation does, so both give the same bits.
+inline void integrateAxis(float *pos, float *vel, const float *radius, size_t count, float limit)
+{
+    size_t i = 0;
+#ifdef CIRCLES_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 edge = _mm_set1_ps(limit);
+    const __m128 sign = _mm_set1_ps(-0.f);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 p = _mm_loadu_ps(pos + i);
+        __m128 v = _mm_loadu_ps(vel + i);
+        __m128 r = _mm_loadu_ps(radius + i);
+        __m128 hit = _mm_or_ps(_mm_cmple_ps(_mm_sub_ps(p, r), zero), _mm_cmpge_ps(_mm_add_ps(p, r), edge));
+        v = _mm_xor_ps(v, _mm_and_ps(hit, sign));
+        _mm_storeu_ps(vel + i, v);
+        _mm_storeu_ps(pos + i, _mm_add_ps(p, v));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        if (pos[i] - radius[i] <= 0 || pos[i] + radius[i] >= limit)
+            vel[i] = -vel[i];
+        pos[i] += vel[i];
+    }
+}
+
+inline void integrate(Particles &balls, float width, float height)
+{
+    integrateAxis(balls.x.data(), balls.vx.data(), balls.radius.data(), balls.size(), width);
+    integrateAxis(balls.y.data(), balls.vy.data(), balls.radius.data(), balls.size(), height);
+}
+
+// balls are independent here, so any split gives the same result
+inline void integrate(Particles &balls, float width, float height, WorkerPool &pool)
+{
+    const int chunk = 16384;
+    int count = (int)balls.size();
+    pool.run((count + chunk - 1) / chunk, [&](int job)
+    {
+        size_t first = (size_t)job * chunk;
+        size_t n = std::min<size_t>(chunk, count - first);
+        integrateAxis(balls.x.data() + first, balls.vx.data() + first, balls.radius.data() + first, n, width);
+        integrateAxis(balls.y.data() + first, balls.vy.data() + first, balls.radius.data() + first, n, height);
+    });
+}
+
+// Uniform grid broadphase. Cells are one largest-diameter wide, so a ball
+// can only touch balls in its own cell and the eight around it. The grid is
+// rebuilt every frame with a counting sort over the cell indices.
+//
+// A cell only reaches into its own row and the one below, so two rows of
+// the same parity never touch the same balls. resolve() runs all even rows
+// across the workers, then all odd rows, each row left to right. Nothing
+// depends on which worker takes a row, so the result is the same for any
+// worker count.
+class CollisionGrid
+{
+private:
+    float cellSize = 1;
+    int cols = 0;
+    int rows = 0;
+    std::vector<int> cellStart; // where each cell's balls begin in cellBalls
+    std::vector<int> cellBalls;
+    std::vector<int> ballCell;
+
+    // exact circle-circle test, then an elastic exchange along the normal
+    // with mass proportional to area
+    bool collide(Particles &balls, int a, int b)
+    {
+        float dx = balls.x[b] - balls.x[a];
+        float dy = balls.y[b] - balls.y[a];
+        float distSq = dx * dx + dy * dy;
+        float ra = balls.radius[a];
+        float rb = balls.radius[b];
+        float reach = ra + rb;
+        if (distSq >= reach * reach || distSq == 0)
+            return false;
+
+        float dist = std::sqrt(distSq);
+        float nx = dx / dist;
+        float ny = dy / dist;
+        float invA = 1.f / (ra * ra);
+        float invB = 1.f / (rb * rb);
+        float share = (reach - dist) / (invA + invB);
+        balls.x[a] -= nx * share * invA;
+        balls.y[a] -= ny * share * invA;
+        balls.x[b] += nx * share * invB;
+        balls.y[b] += ny * share * invB;
+
+        float approach = (balls.vx[b] - balls.vx[a]) * nx + (balls.vy[b] - balls.vy[a]) * ny;
+        if (approach < 0)
+        {
+            float impulse = -2 * approach / (invA + invB);
+            balls.vx[a] -= nx * impulse * invA;
+            balls.vy[a] -= ny * impulse * invA;
+            balls.vx[b] += nx * impulse * invB;
+            balls.vy[b] += ny * impulse * invB;
+        }
+        return true;
+    }
+
+    // each pair is visited once: later balls in the same cell, then the
+    // east, south-west, south and south-east neighbours
+    void resolveCell(Particles &balls, int cx, int cy, long long &pairs, long long &hits)
+    {
+        const int dx[4] = {1, -1, 0, 1};
+        const int dy[4] = {0, 1, 1, 1};
+        int c = cy * cols + cx;
+        for (int i = cellStart[c]; i < cellStart[c + 1]; i++)
+        {
+            for (int j = i + 1; j < cellStart[c + 1]; j++)
+            {
+                pairs++;
+                hits += collide(balls, cellBalls[i], cellBalls[j]);
+            }
+            for (int k = 0; k < 4; k++)
+            {
+                int nx = cx + dx[k];
+                int ny = cy + dy[k];
+                if (nx < 0 || nx >= cols || ny >= rows)
+                    continue;
+                int n = ny * cols + nx;
+                for (int j = cellStart[n]; j < cellStart[n + 1]; j++)
+                {
+                    pairs++;
+                    hits += collide(balls, cellBalls[i], cellBalls[j]);
+                }
+            }
+        }
+    }
+
+public:
+    std::atomic<long long> pairsTested{0};
+    std::atomic<long long> contacts{0};
+
+    void build(const Particles &balls, float width, float height, float maxRadius)
+    {
+        cellSize = std::max(1.f, maxRadius * 2);
+        cols = std::max(1, (int)std::ceil(width / cellSize));
+        rows = std::max(1, (int)std::ceil(height / cellSize));
+        cellStart.assign(cols * rows + 1, 0);
+        ballCell.resize(balls.size());
+        cellBalls.resize(balls.size());
+
+        for (size_t i = 0; i < balls.size(); i++)
+        {
+            int cx = std::clamp((int)(balls.x[i] / cellSize), 0, cols - 1);
+            int cy = std::clamp((int)(balls.y[i] / cellSize), 0, rows - 1);
+            ballCell[i] = cy * cols + cx;
+            cellStart[ballCell[i] + 1]++;
+        }
+        for (int c = 0; c < cols * rows; c++)
+            cellStart[c + 1] += cellStart[c];
+        std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+        for (size_t i = 0; i < balls.size(); i++)
+            cellBalls[fill[ballCell[i]]++] = (int)i;
+    }
+
+    void resolve(Particles &balls, WorkerPool &pool)
+    {
+        for (int parity = 0; parity < 2; parity++)
+        {
+            pool.run((rows - parity + 1) / 2, [&](int job)
+            {
+                int cy = parity + job * 2;
+                long long pairs = 0;
+                long long hits = 0;
+                for (int cx = 0; cx < cols; cx++)
+                    resolveCell(balls, cx, cy, pairs, hits);
+                pairsTested += pairs;
+                contacts += hits;
+            });
+        }
+    }
+};
+
+// One step is one frame of the old 180 fps loop, so velocities are still
+// pixels per step.
+const int PHYSICS_HZ = 180;
+
+// One physics step over every ball: move and bounce off the edges, rebuild
+// the grid, then settle ball-ball contacts.
+class Simulation
+{
+private:
+    CollisionGrid grid;
+    WorkerPool pool;
+
+public:
+    Particles balls;
+    std::vector<float> prevX; // positions before the last step, for drawing
+    std::vector<float> prevY; // in between steps
+    float width;
+    float height;
+    float maxRadius = 0;
+    double collisionMs = 0; // grid build and resolve in the last step
+
+    Simulation(float width, float height, unsigned threads) : pool(threads, "physics worker"), width(width), height(height)
+    {
+    }
+
+    void add(float x, float y, float vx, float vy, float radius, uint32_t rgba)
+    {
+        balls.add(x, y, vx, vy, radius, rgba);
+        prevX.push_back(x);
+        prevY.push_back(y);
+        maxRadius = std::max(maxRadius, radius);
+    }
+
+    void step()
+    {
+        prevX = balls.x;
+        prevY = balls.y;
+        integrate(balls, width, height, pool);
+        auto start = std::chrono::steady_clock::now();
+        grid.build(balls, width, height, maxRadius);
+        grid.resolve(balls, pool);
+        collisionMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    unsigned getWorkers() const
+    {
+        return pool.size();
+    }
+
+    long long getPairsTested() const
+    {
+        return grid.pairsTested;
+    }
+
+    long long getContacts() const
+    {
+        return grid.contacts;
+    }
+
+    // same state gives the same value, for comparing runs
+    uint64_t checksum() const
+    {
+        uint64_t h = 1469598103934665603ull;
+        for (size_t i = 0; i < balls.size(); i++)
+        {
+            uint32_t bits[2];
+            std::memcpy(&bits[0], &balls.x[i], 4);
+            std::memcpy(&bits[1], &balls.y[i], 4);
+            h = (h ^ bits[0]) * 1099511628211ull;
+            h = (h ^ bits[1]) * 1099511628211ull;
+        }
+        return h;
+    }
+};
+
+// Everything that decides a workload, so a run can be repeated exactly.
+struct Scenario
+{
+    enum Layout
+    {
+        UNIFORM, // anywhere in the box; clicks cluster at the cursor instead
+        CLUSTER, // bunched around the spawn point
+        RING     // on a circle round the spawn point, moving along it
+    };
+
+    uint64_t seed = 1;
+    int count = 0;      // balls in the opening burst
+    int clickBurst = 1; // balls per mouse click
+    float minRadius = 20;
+    float maxRadius = 50;
+    float minSpeed = 1; // pixels per step
+    float maxSpeed = 5;
+    Layout layout = UNIFORM;
+    int steps = 0; // 0 runs until the window closes
+};
+
+// xoshiro128+ seeded through splitmix64. It fills whole arrays at a time,
+// so a burst draws each attribute in one tight loop.
+class BatchRandom
+{
+private:
+    uint32_t s[4];
+
+    static uint32_t rotl(uint32_t x, int k)
+    {
+        return (x << k) | (x >> (32 - k));
+    }
+
+public:
+    explicit BatchRandom(uint64_t seed)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            seed += 0x9E3779B97F4A7C15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            s[i] = (uint32_t)(z ^ (z >> 31));
+        }
+    }
+
+    uint32_t next()
+    {
+        uint32_t result = s[0] + s[3];
+        uint32_t t = s[1] << 9;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 11);
+        return result;
+    }
+
+    // uniform in [lo, hi) from the top 24 bits
+    void fill(float *out, size_t n, float lo, float hi)
+    {
+        const float scale = (hi - lo) / 16777216.f;
+        for (size_t i = 0; i < n; i++)
+            out[i] = lo + (float)(next() >> 8) * scale;
+    }
+
+    void fillBits(uint32_t *out, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            out[i] = next();
+    }
+};
+
+// Adds balls drawn from a scenario's distributions. Nothing is drawn
+// unless balls are actually spawned.
+class Spawner
+{
+private:
+    Scenario scenario;
+    BatchRandom random;
+    std::vector<float> radius;
+    std::vector<float> u;
+    std::vector<float> v;
+    std::vector<float> speed;
+    std::vector<float> heading;
+    std::vector<uint32_t> color;
+
+    void scatter(Simulation &sim, int count, float cx, float cy, Scenario::Layout layout)
+    {
+        if (count <= 0)
+            return;
+        radius.resize(count);
+        u.resize(count);
+        v.resize(count);
+        speed.resize(count);
+        heading.resize(count);
+        color.resize(count);
+        random.fill(radius.data(), count, scenario.minRadius, scenario.maxRadius);
+        random.fill(u.data(), count, 0, 1);
+        random.fill(v.data(), count, 0, 1);
+        random.fill(speed.data(), count, scenario.minSpeed, scenario.maxSpeed);
+        random.fill(heading.data(), count, 0, 6.2831853f);
+        random.fillBits(color.data(), count);
+
+        float spread = std::sqrt((float)count) * scenario.maxRadius;
+        float ring = std::min(sim.width, sim.height) * 0.35f;
+        sim.balls.reserve(sim.balls.size() + count);
+        for (int i = 0; i < count; i++)
+        {
+            float r = radius[i];
+            float x, y;
+            float angle = heading[i];
+            switch (layout)
+            {
+            case Scenario::CLUSTER:
+                // uniform in distance, so densest at the centre
+                x = cx + std::cos(v[i] * 6.2831853f) * u[i] * spread;
+                y = cy + std::sin(v[i] * 6.2831853f) * u[i] * spread;
+                break;
+            case Scenario::RING:
+                x = cx + std::cos(u[i] * 6.2831853f) * ring;
+                y = cy + std::sin(u[i] * 6.2831853f) * ring;
+                angle = u[i] * 6.2831853f + 1.5707963f;
+                break;
+            default:
+                x = u[i] * sim.width;
+                y = v[i] * sim.height;
+                break;
+            }
+            x = std::clamp(x, r + 1, std::max(r + 1, sim.width - r - 1));
+            y = std::clamp(y, r + 1, std::max(r + 1, sim.height - r - 1));
+            sim.add(x, y, std::cos(angle) * speed[i], std::sin(angle) * speed[i], r, color[i] | 0xFF);
+        }
+    }
+
+public:
+    explicit Spawner(const Scenario &scenario) : scenario(scenario), random(scenario.seed)
+    {
+    }
+
+    const Scenario &getScenario() const
+    {
+        return scenario;
+    }
+
+    // a click: the balls come out around (cx, cy) whatever the layout
+    void burst(Simulation &sim, int count, float cx, float cy)
+    {
+        scatter(sim, count, cx, cy, scenario.layout == Scenario::UNIFORM ? Scenario::CLUSTER : scenario.layout);
+    }
+
+    void opening(Simulation &sim)
+    {
+        scatter(sim, scenario.count, sim.width / 2, sim.height / 2, scenario.layout);
+    }
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+// CPU rasterizer for running Circles without a display or GPU. Draws into
+// an RGBA framebuffer and writes frames out as PPM images. Only the
+// --headless mode uses it; the window draws through SFML on its own path.
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <algorithm>
+#include "Simulation.h"
+
+// Pixels are packed 0xRRGGBBAA, the same as ball colours.
+class Framebuffer
+{
+private:
+    int width;
+    int height;
+    std::vector<uint32_t> pixels;
+
+    // one horizontal run, four pixels per store where SSE2 is available
+    void fillSpan(uint32_t *row, int x0, int x1, uint32_t rgba)
+    {
+        int x = x0;
+#ifdef CIRCLES_SSE2
+        const __m128i fill = _mm_set1_epi32((int)rgba);
+        for (; x + 4 <= x1 + 1; x += 4)
+            _mm_storeu_si128((__m128i *)(row + x), fill);
+#endif
+        for (; x <= x1; x++)
+            row[x] = rgba;
+    }
+
+public:
+    long long pixelsFilled = 0; // by circles; clearing is not counted
+
+    Framebuffer(int width, int height) : width(width), height(height), pixels((size_t)width * height)
+    {
+    }
+
+    int getWidth() const
+    {
+        return width;
+    }
+
+    int getHeight() const
+    {
+        return height;
+    }
+
+    uint32_t at(int x, int y) const
+    {
+        return pixels[(size_t)y * width + x];
+    }
+
+    void clear(uint32_t rgba)
+    {
+        for (int y = 0; y < height; y++)
+            fillSpan(&pixels[(size_t)y * width], 0, width - 1, rgba);
+    }
+
+    // covers the pixels whose centres fall inside the circle
+    void fillCircle(float cx, float cy, float r, uint32_t rgba)
+    {
+        int y0 = std::max(0, (int)std::ceil(cy - r - 0.5f));
+        int y1 = std::min(height - 1, (int)std::floor(cy + r - 0.5f));
+        for (int y = y0; y <= y1; y++)
+        {
+            float dy = y + 0.5f - cy;
+            float reach = r * r - dy * dy;
+            if (reach < 0)
+                continue;
+            float half = std::sqrt(reach);
+            int x0 = std::max(0, (int)std::ceil(cx - half - 0.5f));
+            int x1 = std::min(width - 1, (int)std::floor(cx + half - 0.5f));
+            if (x0 <= x1)
+            {
+                fillSpan(&pixels[(size_t)y * width], x0, x1, rgba);
+                pixelsFilled += x1 - x0 + 1;
+            }
+        }
+    }
+
+    // a black disc one outline wider, with the ball's colour on top, to
+    // match the windowed look
+    void drawBall(float cx, float cy, float r, uint32_t rgba, float outline)
+    {
+        fillCircle(cx, cy, r + outline, 0x000000FF);
+        fillCircle(cx, cy, r, rgba);
+    }
+
+    bool savePPM(const std::string &path) const
+    {
+        FILE *file = std::fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+        std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+        std::vector<unsigned char> line((size_t)width * 3);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                uint32_t p = pixels[(size_t)y * width + x];
+                line[x * 3] = (unsigned char)(p >> 24);
+                line[x * 3 + 1] = (unsigned char)(p >> 16);
+                line[x * 3 + 2] = (unsigned char)(p >> 8);
+            }
+            std::fwrite(line.data(), 1, line.size(), file);
+        }
+        std::fclose(file);
+        return true;
+    }
+};
+
+// the same picture the window shows, balls blended between physics steps
+inline void drawSimulation(Framebuffer &target, const Simulation &sim, float alpha, float outline = 2)
+{
+    target.clear(0x000000FF);
+    const Particles &balls = sim.balls;
+    for (size_t i = 0; i < balls.size(); i++)
+    {
+        float x = sim.prevX[i] + (balls.x[i] - sim.prevX[i]) * alpha;
+        float y = sim.prevY[i] + (balls.y[i] - sim.prevY[i]) * alpha;
+        target.drawBall(x, y, balls.radius[i], balls.color[i], outline);
+    }
+}
@@ -2,73 +2,415 @@
 #include <SFML/Graphics.hpp>
 #include <vector>
 #include <cstdlib>
-#include <ctime>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include "Simulation.h"
+#include "SoftwareRenderer.h"
+#include "FrameStats.h"
 
-struct Ball
+// the simulation's packed 0xRRGGBBAA as an SFML colour
+sf::Color unpackColor(uint32_t rgba)
 {
-    sf::CircleShape shape;
-    sf::Vector2f velocity;
+    return sf::Color(rgba >> 24, (rgba >> 16) & 0xFF, (rgba >> 8) & 0xFF, rgba & 0xFF);
+}
+
+// All balls as one triangle list, built from shared unit-circle templates:
+// each ball is a black fan one outline wider than the ball with its
+// coloured fan on top, scaled and moved into place. Small balls use a
+// coarser template. The whole list goes out in one draw call.
+class CircleBatch
+{
+private:
+    static const int LEVELS = 3;
+    static const int MAX_SEGMENTS = 32;
+    const int segments[LEVELS] = {8, 16, 32};
+    float unitX[LEVELS][MAX_SEGMENTS + 1];
+    float unitY[LEVELS][MAX_SEGMENTS + 1];
+    std::vector<sf::Vertex> vertices;
+
+    int level(float radius) const
+    {
+        return radius < 6 ? 0 : (radius < 20 ? 1 : 2);
+    }
+
+    sf::Vertex *fan(sf::Vertex *v, int lod, float cx, float cy, float r, sf::Color color) const
+    {
+        const float *ux = unitX[lod];
+        const float *uy = unitY[lod];
+        sf::Vector2f center(cx, cy);
+        for (int k = 0; k < segments[lod]; k++)
+        {
+            *v++ = {center, color};
+            *v++ = {sf::Vector2f(cx + ux[k] * r, cy + uy[k] * r), color};
+            *v++ = {sf::Vector2f(cx + ux[k + 1] * r, cy + uy[k + 1] * r), color};
+        }
+        return v;
+    }
 
-    Ball(float radius, sf::Vector2f pos, sf::Vector2f vel, sf::Color color)
+public:
+    float outline = 2;
+
+    CircleBatch()
     {
-        shape.setRadius(radius);
-        shape.setPosition(pos);
-        shape.setFillColor(color);
-        shape.setOutlineThickness(2);
-        shape.setOutlineColor(sf::Color::Black);
-        velocity = vel;
+        for (int l = 0; l < LEVELS; l++)
+            for (int k = 0; k <= segments[l]; k++)
+            {
+                float angle = k * 2 * 3.14159265f / segments[l];
+                unitX[l][k] = std::cos(angle);
+                unitY[l][k] = std::sin(angle);
+            }
     }
 
-    void update(const sf::Vector2u &windowSize)
+    // alpha blends each ball between its last two physics positions
+    void build(const Simulation &sim, float alpha)
     {
-        sf::Vector2f pos = shape.getPosition();
-        float diameter = shape.getRadius() * 2;
+        const Particles &balls = sim.balls;
+        size_t total = 0;
+        for (size_t i = 0; i < balls.size(); i++)
+            total += segments[level(balls.radius[i])] * 6;
+        vertices.resize(total);
 
-        // Bounce off edges
-        if (pos.x <= 0 || pos.x + diameter >= windowSize.x)
-            velocity.x = -velocity.x;
-        if (pos.y <= 0 || pos.y + diameter >= windowSize.y)
-            velocity.y = -velocity.y;
+        sf::Vertex *v = vertices.data();
+        for (size_t i = 0; i < balls.size(); i++)
+        {
+            float r = balls.radius[i];
+            float x = sim.prevX[i] + (balls.x[i] - sim.prevX[i]) * alpha;
+            float y = sim.prevY[i] + (balls.y[i] - sim.prevY[i]) * alpha;
+            int lod = level(r);
+            v = fan(v, lod, x, y, r + outline, sf::Color::Black);
+            v = fan(v, lod, x, y, r, unpackColor(balls.color[i]));
+        }
+    }
 
-        shape.move(velocity);
+    void draw(sf::RenderWindow &window) const
+    {
+        if (!vertices.empty())
+            window.draw(vertices.data(), vertices.size(), sf::PrimitiveType::Triangles);
+    }
+
+    size_t vertexCount() const
+    {
+        return vertices.size();
     }
 };
 
-Ball createBall(float radius, sf::Vector2i pos, sf::Vector2f vel, sf::Color color)
+// Small balls at about a fifth coverage of the box, the workload all the
+// physics benchmarks share. Only the seed comes from the command line.
+Scenario boxScenario(int count, uint64_t seed)
+{
+    Scenario scenario;
+    scenario.seed = seed;
+    scenario.count = count;
+    scenario.minRadius = 2;
+    scenario.maxRadius = 6;
+    scenario.minSpeed = 0;
+    scenario.maxSpeed = 2;
+    return scenario;
+}
+
+float boxSide(int count)
+{
+    return std::sqrt(count * 3.14159f * 16 / 0.2f);
+}
+
+// Times the vertex build alone, with no window, for a few ball counts.
+void benchmarkVertices(uint64_t seed)
+{
+    const int counts[] = {1000, 10000, 100000};
+    const int frames = 60;
+    for (int count : counts)
+    {
+        Scenario scenario = boxScenario(count, seed);
+        scenario.maxRadius = 50;
+        Simulation sim(1000, 1000, 1);
+        Spawner(scenario).opening(sim);
+
+        CircleBatch batch;
+        auto start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++)
+            batch.build(sim, 0.5f);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << count << " balls: " << seconds * 1000 / frames << " ms/frame, "
+                  << batch.vertexCount() << " vertices, "
+                  << (long long)(batch.vertexCount() * frames / seconds) << " vertices/s\n";
+    }
+}
+
+// Steps a box of small balls at a fixed coverage for each count and reports
+// the collision cost against the 60 fps frame budget.
+void benchmarkCollisions(uint64_t seed)
+{
+    const int counts[] = {1000, 10000, 100000};
+    const int frames = 60;
+    for (int count : counts)
+    {
+        float side = boxSide(count);
+        Simulation sim(side * 4 / 3, side * 3 / 4, 1);
+        Spawner(boxScenario(count, seed)).opening(sim);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++)
+            sim.step();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double frameMs = seconds * 1000 / frames;
+
+        std::cout << count << " balls: " << frameMs << " ms/frame, "
+                  << (long long)(sim.getPairsTested() / seconds) << " pairs/s, "
+                  << (long long)(sim.getContacts() / seconds) << " contacts/s"
+                  << (frameMs <= 1000.0 / 60 ? "" : " (below 60 fps)") << '\n';
+    }
+}
+
+// Speedup of the physics step from one worker up to every core, and a check
+// that every worker count ends on exactly the same state.
+void benchmarkThreads(uint64_t seed)
+{
+    const int counts[] = {10000, 100000, 1000000};
+    const int steps = 20;
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for (int count : counts)
+    {
+        float side = boxSide(count);
+        double baseMs = 0;
+        uint64_t reference = 0;
+        for (unsigned threads = 1; threads <= cores; threads++)
+        {
+            Simulation sim(side * 4 / 3, side * 3 / 4, threads);
+            Spawner(boxScenario(count, seed)).opening(sim);
+
+            auto start = std::chrono::steady_clock::now();
+            for (int s = 0; s < steps; s++)
+                sim.step();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / steps;
+            if (threads == 1)
+            {
+                baseMs = ms;
+                reference = sim.checksum();
+            }
+
+            std::cout << count << " balls, " << threads << " workers: " << ms << " ms/step, speedup "
+                      << baseMs / ms << (sim.checksum() == reference ? "" : " (MISMATCH)") << '\n';
+        }
+    }
+}
+
+// Steps a scenario with no rendering and prints a checksum of the final
+// state, so two builds or machines can be compared.
+void runScenario(const Scenario &scenario)
+{
+    Simulation sim(1280, 720, std::max(1u, std::thread::hardware_concurrency()));
+    Spawner(scenario).opening(sim);
+    int steps = scenario.steps > 0 ? scenario.steps : PHYSICS_HZ * 60;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < steps; s++)
+        sim.step();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "balls: " << sim.balls.size() << " (seed " << scenario.seed << ")\n";
+    std::cout << "steps: " << steps << "\n";
+    std::cout << "steps/s: " << (long long)(steps / seconds) << "\n";
+    std::cout << "contacts: " << sim.getContacts() << "\n";
+    std::cout << "checksum: " << std::hex << sim.checksum() << std::dec << "\n";
+}
+
+// What to run and where the results go, apart from the scene itself.
+struct Options
+{
+    int frames = 0;      // headless frames; 0 takes them from --steps, else 600
+    std::string ppmPath; // headless: the last frame as an image
+    std::string csvPath; // every frame's timings, written on exit
+};
+
+// Runs the scene on the CPU rasterizer instead of a window, at a fixed 60
+// frames per simulated second, and reports the raster throughput.
+void runHeadless(const Scenario &scenario, const Options &options)
+{
+    const int stepsPerFrame = PHYSICS_HZ / 60;
+    int frames = options.frames;
+    if (frames <= 0)
+        frames = scenario.steps > 0 ? (scenario.steps + stepsPerFrame - 1) / stepsPerFrame : 600;
+
+    const int width = 1280;
+    const int height = 720;
+    Simulation sim(width, height, std::max(1u, std::thread::hardware_concurrency()));
+    Spawner(scenario).opening(sim);
+
+    Framebuffer target(width, height);
+    FrameStats stats;
+    double rasterSeconds = 0;
+    for (int f = 0; f < frames; f++)
+    {
+        FrameSample sample = {};
+        auto start = std::chrono::steady_clock::now();
+        for (int s = 0; s < stepsPerFrame; s++)
+        {
+            sim.step();
+            sample.collisionMs += (float)sim.collisionMs;
+        }
+        auto mid = std::chrono::steady_clock::now();
+        drawSimulation(target, sim, 1);
+        auto end = std::chrono::steady_clock::now();
+        sample.simMs = std::chrono::duration<float, std::milli>(mid - start).count();
+        sample.renderMs = std::chrono::duration<float, std::milli>(end - mid).count();
+        sample.frameMs = sample.simMs + sample.renderMs;
+        sample.balls = (uint32_t)sim.balls.size();
+        stats.push(sample);
+        rasterSeconds += std::chrono::duration<double>(end - mid).count();
+    }
+
+    FrameSummary s = stats.summarize(frames);
+    std::cout << "frames: " << frames << " (" << sim.balls.size() << " balls, " << width << "x" << height << ")\n";
+    std::cout << "frame: p50 " << s.p50 << " p99 " << s.p99 << " max " << s.max << " ms\n";
+    std::cout << "simulation: " << s.simMs << " ms/frame (collisions " << s.collisionMs << ")\n";
+    std::cout << "raster: " << s.renderMs << " ms/frame\n";
+    std::cout << "circle pixels/s: " << (long long)(target.pixelsFilled / rasterSeconds) << "\n";
+    if (!options.ppmPath.empty())
+        std::cout << (target.savePPM(options.ppmPath) ? "wrote " : "could not write ") << options.ppmPath << "\n";
+    if (!options.csvPath.empty())
+        std::cout << (stats.writeCSV(options.csvPath) ? "wrote " : "could not write ") << options.csvPath << "\n";
+}
+
+// --seed N --balls N --burst N --radius MIN MAX --speed MIN MAX
+// --layout uniform|cluster|ring --steps N, anywhere on the command line
+Scenario parseScenario(int argc, char *argv[])
+{
+    Scenario scenario;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool one = i + 1 < argc;
+        bool two = i + 2 < argc;
+        if (arg == "--seed" && one)
+            scenario.seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--balls" && one)
+            scenario.count = std::atoi(argv[++i]);
+        else if (arg == "--burst" && one)
+            scenario.clickBurst = std::atoi(argv[++i]);
+        else if (arg == "--steps" && one)
+            scenario.steps = std::atoi(argv[++i]);
+        else if (arg == "--radius" && two)
+        {
+            scenario.minRadius = (float)std::atof(argv[++i]);
+            scenario.maxRadius = (float)std::atof(argv[++i]);
+        }
+        else if (arg == "--speed" && two)
+        {
+            scenario.minSpeed = (float)std::atof(argv[++i]);
+            scenario.maxSpeed = (float)std::atof(argv[++i]);
+        }
+        else if (arg == "--layout" && one)
+        {
+            std::string layout = argv[++i];
+            scenario.layout = layout == "cluster" ? Scenario::CLUSTER : (layout == "ring" ? Scenario::RING : Scenario::UNIFORM);
+        }
+    }
+    return scenario;
+}
+
+// --frames N --ppm FILE --stats-csv FILE, anywhere on the command line
+Options parseOptions(int argc, char *argv[])
 {
-    sf::Vector2f convert = {(int)pos.x, (int)pos.y};
-    Ball ball(radius, convert, vel, color);
-    return ball;
+    Options options;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--frames")
+            options.frames = std::atoi(argv[++i]);
+        else if (arg == "--ppm")
+            options.ppmPath = argv[++i];
+        else if (arg == "--stats-csv")
+            options.csvPath = argv[++i];
+    }
+    return options;
 }
 
-int main()
+// the overlay, e.g. "1200 balls  178 fps" over the frame time spread and
+// where the time went
+std::string describe(const FrameSummary &s, size_t balls)
 {
+    char line[256];
+    std::snprintf(line, sizeof(line),
+                  "%zu balls  %.0f fps\nframe p50 %.2f  p99 %.2f  max %.2f ms\nsim %.2f (collide %.2f)  render %.2f ms",
+                  balls, s.fps, s.p50, s.p99, s.max, s.simMs, s.collisionMs, s.renderMs);
+    return line;
+}
+
+int main(int argc, char *argv[])
+{
+    Scenario scenario = parseScenario(argc, argv);
+    Options options = parseOptions(argc, argv);
+
+    // circles --run [scenario options]
+    if (argc > 1 && std::string(argv[1]) == "--run")
+    {
+        runScenario(scenario);
+        return 0;
+    }
+    // circles --headless [--frames N] [--ppm FILE] [--stats-csv FILE] [scenario options]
+    if (argc > 1 && std::string(argv[1]) == "--headless")
+    {
+        if (scenario.count == 0)
+            scenario.count = 200;
+        runHeadless(scenario, options);
+        return 0;
+    }
+    // circles --bench-collisions|--bench-threads|--bench-vertices [--seed N]
+    // these run their own fixed workloads; --seed is the only scenario option
+    if (argc > 1 && std::string(argv[1]) == "--bench-collisions")
+    {
+        benchmarkCollisions(scenario.seed);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-threads")
+    {
+        benchmarkThreads(scenario.seed);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-vertices")
+    {
+        benchmarkVertices(scenario.seed);
+        return 0;
+    }
+
     sf::RenderWindow window(sf::VideoMode({1280, 720}), "Multiple Circles");
     window.setFramerateLimit(180);
 
-    std::srand(static_cast<unsigned>(std::time(nullptr)));
-
-    std::vector<Ball> balls;
+    sf::Vector2u size = window.getSize();
+    Simulation sim((float)size.x, (float)size.y, std::max(1u, std::thread::hardware_concurrency()));
+    Spawner spawner(scenario);
+    spawner.opening(sim);
+    CircleBatch batch;
 
     sf::Font font("Roboto-Italic-VariableFont_wdth,wght.ttf");
-    bool isCreateBall = false;
 
-    while (window.isOpen())
-    {
-        sf::Text text(font, std::to_string(balls.size()));
-        text.setPosition({0, 0});
+    // the overlay is rebuilt a few times a second, not every frame
+    FrameStats stats;
+    sf::Text overlay(font, "", 18);
+    overlay.setPosition({0, 0});
+    auto overlayUpdated = std::chrono::steady_clock::now();
 
-        float radius = 20 + std::rand() % 30; // radius 20–50
-        sf::Vector2f pos(std::rand() % 700, std::rand() % 500);
-        sf::Vector2f vel((std::rand() % 5 + 1) * ((std::rand() % 2 == 0) ? 1 : -1),
-                         (std::rand() % 5 + 1) * ((std::rand() % 2 == 0) ? 1 : -1));
-        sf::Color color(rand() % 256, rand() % 256, rand() % 256);
+    // physics runs at a fixed rate whatever the frame rate; drop time
+    // rather than spiral after a stall
+    const int MAX_STEPS_PER_FRAME = 12;
+    const double stepSeconds = 1.0 / PHYSICS_HZ;
+    double accumulator = 0.0;
+    long long totalSteps = 0;
+    auto previous = std::chrono::steady_clock::now();
 
+    while (window.isOpen())
+    {
         while (const std::optional event = window.pollEvent())
         {
-            if (event->getIf<sf::Event::MouseButtonPressed>())
+            if (const auto *click = event->getIf<sf::Event::MouseButtonPressed>())
             {
-                isCreateBall = true;
+                sf::Vector2i pos = click->position;
+                spawner.burst(sim, scenario.clickBurst, (float)pos.x, (float)pos.y);
+                std::cout << "x: " << pos.x << " y: " << pos.y << '\n';
             }
 
             if (event->is<sf::Event::Closed>())
@@ -77,23 +419,54 @@ int main()
             }
         }
 
-        if (isCreateBall)
+        window.clear(sf::Color::Black);
+
+        auto now = std::chrono::steady_clock::now();
+        FrameSample sample = {};
+        accumulator += std::chrono::duration<double>(now - previous).count();
+        previous = now;
+
+        size = window.getSize();
+        sim.width = (float)size.x;
+        sim.height = (float)size.y;
+        int steps = 0;
+        while (accumulator >= stepSeconds && steps < MAX_STEPS_PER_FRAME)
         {
-            Ball ball = createBall(radius, sf::Mouse::getPosition(window), vel, color);
-            balls.push_back(ball);
-            std::cout << "x: " << sf::Mouse::getPosition().x << " y: " << sf::Mouse::getPosition().y << '\n';
-            isCreateBall = false;
+            sim.step();
+            sample.collisionMs += (float)sim.collisionMs;
+            accumulator -= stepSeconds;
+            steps++;
         }
+        auto stepped = std::chrono::steady_clock::now();
+        sample.simMs = std::chrono::duration<float, std::milli>(stepped - now).count();
+        if (steps == MAX_STEPS_PER_FRAME)
+            accumulator = 0.0;
 
-        window.clear(sf::Color::Black);
+        // a scripted run ends after its steps
+        totalSteps += steps;
+        if (scenario.steps > 0 && totalSteps >= scenario.steps)
+            window.close();
 
-        for (auto &ball : balls)
+        batch.build(sim, (float)(accumulator / stepSeconds));
+        batch.draw(window);
+
+        auto drawn = std::chrono::steady_clock::now();
+        sample.renderMs = std::chrono::duration<float, std::milli>(drawn - stepped).count();
+        sample.balls = (uint32_t)sim.balls.size();
+        if (drawn - overlayUpdated >= std::chrono::milliseconds(250))
         {
-            ball.update(window.getSize());
-            window.draw(ball.shape);
+            overlay.setString(describe(stats.summarize(PHYSICS_HZ), sim.balls.size()));
+            overlayUpdated = drawn;
         }
 
-        window.draw(text);
+        window.draw(overlay);
         window.display();
+
+        // pushed last so the frame time covers the same frame as the rest
+        sample.frameMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - now).count();
+        stats.push(sample);
     }
+
+    if (!options.csvPath.empty())
+        std::cout << (stats.writeCSV(options.csvPath) ? "wrote " : "could not write ") << options.csvPath << '\n';
 }
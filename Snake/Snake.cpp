@@ -2,69 +2,323 @@
 #include <iostream>
 #include <vector>
 #include <limits>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include "../SpaceShooter/ConsoleGameEnigne/Profiler.h"
+#include "../SpaceShooter/ConsoleGameEnigne/WorkerPool.h"
 using namespace std;
 
-const int ROW = 25;
-const int COLUM = 50;
-vector<COORD> snake_position(ROW * COLUM , {15 , 0});
-COORD last_position;
-int snake_length = 1;
+// the headless benchmark resizes the board
+int ROW = 25;
+int COLUM = 50;
 
-void drawMap(HANDLE output)
+// Body segments in a ring buffer, head first. A move writes one new head
+// slot and drops the tail slot, so it costs the same at any length. The
+// ring doubles when full, so it holds about as many slots as the snake
+// is long rather than one per board cell.
+struct SnakeBody
 {
-    for(int i = 0; i < COLUM; i++)
+    vector<COORD> ring;
+    int head = 0;
+    int length = 0;
+
+    void reset()
     {
-        SetConsoleCursorPosition(output , {(short)i , 1});
-        cout << '#';
+        ring.assign(16 , {0 , 0});
+        head = 0;
+        length = 0;
     }
-    for(int i = 0; i < COLUM; i++)
+
+    COORD segment(int i) const
     {
-        SetConsoleCursorPosition(output , {(short)i , ROW});
-        cout << '#';
+        return ring[(head + i) % ring.size()];
     }
-    for(int i = 1; i <= ROW; i++)
+
+    COORD tail() const
     {
-        SetConsoleCursorPosition(output , {0 , (short)i});
-        cout << '#';
+        return segment(length - 1);
     }
-    for(int i = 1; i <= ROW; i++)
+
+    void grow()
+    {
+        vector<COORD> bigger(ring.size() * 2);
+        for(int i = 0; i < length; i++)
+        bigger[i] = segment(i);
+        ring.swap(bigger);
+        head = 0;
+    }
+
+    void pushHead(COORD position)
+    {
+        if(length == (int)ring.size())
+        grow();
+        head = (head + (int)ring.size() - 1) % ring.size();
+        ring[head] = position;
+        length++;
+    }
+
+    void popTail()
+    {
+        length--;
+    }
+};
+
+// One bit per board cell, set where a body segment is.
+struct Occupancy
+{
+    int width = 0;
+    int height = 0;
+    vector<uint64_t> bits;
+
+    void reset(int w , int h)
+    {
+        width = w;
+        height = h;
+        bits.assign(((size_t)w * h + 63) / 64 , 0);
+    }
+
+    size_t index(COORD c) const
+    {
+        return (size_t)c.Y * width + c.X;
+    }
+
+    bool inside(COORD c) const
+    {
+        return c.X >= 0 && c.X < width && c.Y >= 0 && c.Y < height;
+    }
+
+    bool test(COORD c) const
+    {
+        return inside(c) && (bits[index(c) / 64] >> (index(c) % 64)) & 1;
+    }
+
+    void set(COORD c)
+    {
+        bits[index(c) / 64] |= uint64_t(1) << (index(c) % 64);
+    }
+
+    void clear(COORD c)
+    {
+        bits[index(c) / 64] &= ~(uint64_t(1) << (index(c) % 64));
+    }
+};
+
+// A set of board cells kept as an index array plus each cell's slot in it,
+// so adding, removing and sampling a random cell are all O(1). Holds the
+// cells a fruit may spawn on, and the arena's fruits.
+struct CellSet
+{
+    int width = 0;
+    vector<int> cells;
+    vector<int> slot;  // -1 when the cell is not free
+
+    void reset(int w , int h)
+    {
+        width = w;
+        cells.clear();
+        slot.assign((size_t)w * h , -1);
+    }
+
+    int index(COORD c) const
+    {
+        return c.Y * width + c.X;
+    }
+
+    void add(COORD c)
+    {
+        int i = index(c);
+        if(slot[i] != -1)
+        return;
+        slot[i] = (int)cells.size();
+        cells.push_back(i);
+    }
+
+    bool contains(COORD c) const
+    {
+        return slot[index(c)] != -1;
+    }
+
+    void remove(COORD c)
+    {
+        int i = index(c);
+        int s = slot[i];
+        if(s == -1)
+        return;
+        int last = cells.back();
+        cells[s] = last;
+        slot[last] = s;
+        cells.pop_back();
+        slot[i] = -1;
+    }
+
+    bool empty() const
+    {
+        return cells.empty();
+    }
+
+    int size() const
+    {
+        return (int)cells.size();
+    }
+
+    COORD at(int s) const
+    {
+        return {(short)(cells[s] % width) , (short)(cells[s] / width)};
+    }
+
+    COORD pick(mt19937& rng) const
+    {
+        return at(uniform_int_distribution<int>(0 , size() - 1)(rng));
+    }
+};
+
+// Everything one snake owns; the board it moves on is shared.
+struct Snake
+{
+    SnakeBody body;
+    int length = 1;                 // grows on fruit; the body catches up one move at a time
+    COORD last_position = {0 , 0};
+    bool tail_moved = false;        // last_position needs erasing
+    bool bit_itself = false;        // the last move ran into a body
+};
+
+Occupancy occupancy;
+CellSet free_cells;
+mt19937 rng;
+Snake player;
+
+// Collects the cells that changed this tick as ANSI cursor moves and
+// glyphs, then hands them to the console in a single write.
+struct Renderer
+{
+    HANDLE output;
+    string frame;
+
+    Renderer(HANDLE output) : output(output)
+    {
+        DWORD mode = 0;
+        GetConsoleMode(output , &mode);
+        SetConsoleMode(output , mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+        frame.reserve(4096);
+    }
+
+    void moveTo(COORD c)
     {
-        SetConsoleCursorPosition(output , {COLUM , (short)i});
-        cout << '#';
+        frame += "\x1b[";
+        frame += to_string(c.Y + 1);
+        frame += ';';
+        frame += to_string(c.X + 1);
+        frame += 'H';
     }
+
+    void put(COORD c , char glyph)
+    {
+        moveTo(c);
+        frame += glyph;
+    }
+
+    void text(COORD c , const string& s)
+    {
+        moveTo(c);
+        frame += s;
+    }
+
+    void clear()
+    {
+        frame += "\x1b[2J\x1b[H";
+    }
+
+    void flush()
+    {
+        if(frame.empty())
+        return;
+        DWORD written = 0;
+        WriteConsoleA(output , frame.data() , (DWORD)frame.size() , &written , NULL);
+        frame.clear();
+    }
+};
+
+void resetBoard()
+{
+    occupancy.reset(COLUM + 1 , ROW + 1);
+    free_cells.reset(COLUM + 1 , ROW + 1);
+    for(short y = 2; y < ROW; y++)
+    for(short x = 1; x < COLUM - 1; x++)
+    free_cells.add({x , y});
 }
 
-void drawPlayer(HANDLE output)
+void spawnSnake(Snake& snake , COORD start)
 {
-    int i = 0;
-    for(; i < snake_length; i++)
+    snake.body.reset();
+    snake.body.pushHead(start);
+    occupancy.set(start);
+    free_cells.remove(start);
+    snake.length = 1;
+    snake.tail_moved = false;
+    snake.bit_itself = false;
+}
+
+// the walls never change, so this only runs when a round starts
+void drawMap(Renderer& renderer)
+{
+    renderer.moveTo({0 , 1});
+    renderer.frame.append(COLUM , '#');
+    renderer.moveTo({0 , (short)ROW});
+    renderer.frame.append(COLUM , '#');
+    for(int i = 1; i <= ROW; i++)
     {
-        SetConsoleCursorPosition(output , snake_position[i]);
-        if(i == 0)
-        std::cout << "O";
-        else
-        std::cout << "o";
+        renderer.put({0 , (short)i} , '#');
+        renderer.put({(short)COLUM , (short)i} , '#');
     }
-    SetConsoleCursorPosition(output , last_position);
-    cout << ' ';
 }
 
-bool collision(COORD position)
+void drawScore(Renderer& renderer , int score)
+{
+    renderer.text({0 , 0} , "Score : " + to_string(score));
+}
+
+// only the cells a move touched: the vacated tail, the old head that
+// became body, and the new head
+void drawPlayer(Renderer& renderer , const Snake& snake)
+{
+    if(snake.tail_moved)
+    renderer.put(snake.last_position , ' ');
+    if(snake.body.length > 1)
+    renderer.put(snake.body.segment(1) , 'o');
+    renderer.put(snake.body.segment(0) , 'O');
+}
+
+bool wall(COORD position)
 {
     if(position.X == COLUM - 1 || position.X == 0)
     return true;
     if(position.Y == ROW || position.Y == 1)
     return true;
+    return false;
+}
 
-    for(int i = 1; i < snake_length; i++)
-    if(position.X == snake_position[i].X && position.Y == snake_position[i].Y)
+bool collision(const Snake& snake , COORD position)
+{
+    if(wall(position))
     return true;
 
-    return false;
+    // the head cell was checked against the bitmap as it moved
+    return snake.bit_itself;
 }
 
-void control(char& move)
+void control(char& move , bool& autoplay)
 {
+    if(GetAsyncKeyState('P') & 0b1)
+    autoplay = !autoplay;
+
     if((GetAsyncKeyState('A') & 0b1) && move != 'd')
     move = 'a';
     else if((GetAsyncKeyState('D') & 0b1) && move != 'a')
@@ -75,19 +329,32 @@ void control(char& move)
     move = 's';
 }
 
-void moveDirection(char control , short& x , short& y)
+// the tail leaves first, so following it into its old cell is fine
+void vacateTail(Snake& snake)
 {
-    if(snake_length == 1)
-    {
-        last_position.X = x;
-        last_position.Y = y;
-    }
-    else
+    snake.tail_moved = snake.body.length >= snake.length;
+    if(!snake.tail_moved)
+    return;
+    snake.last_position = snake.body.tail();
+    occupancy.clear(snake.last_position);
+    if(occupancy.inside(snake.last_position))
+    free_cells.add(snake.last_position);
+    snake.body.popTail();
+}
+
+void advanceHead(Snake& snake , COORD head)
+{
+    snake.bit_itself = occupancy.test(head);
+    snake.body.pushHead(head);
+    if(occupancy.inside(head))
     {
-        last_position = snake_position[snake_length - 1];
+        occupancy.set(head);
+        free_cells.remove(head);
     }
+}
 
-
+void stepPosition(char control , short& x , short& y)
+{
     switch (control)
     {
     case 'a':
@@ -105,12 +372,13 @@ void moveDirection(char control , short& x , short& y)
     default:
         break;
     }
+}
 
-    for(int i = snake_length - 1; i >= 0; i--)
-    {
-        snake_position[i] = snake_position[i - 1]; 
-    }
-    snake_position[0] = {x , y};
+void moveDirection(Snake& snake , char control , short& x , short& y)
+{
+    vacateTail(snake);
+    stepPosition(control , x , y);
+    advanceHead(snake , {x , y});
 }
 
 bool eatFruit(COORD snake_pos , COORD fruit_pos)
@@ -120,29 +388,761 @@ bool eatFruit(COORD snake_pos , COORD fruit_pos)
     return false;
 }
 
-void UpdateFruit(int& score , COORD& fruit_pos , HANDLE output)
+bool UpdateFruit(Snake& snake , int& score , COORD& fruit_pos)
 {
-    short x_min = 4;
-    short y_min = 3;
-    short x_max = 48;
-    short y_max = 24;
-    
-    if(eatFruit(snake_position[0] , fruit_pos))
+    if(!eatFruit(snake.body.segment(0) , fruit_pos))
+    return false;
+
+    score++;
+    snake.length++;
+    // the head sits on the eaten fruit, so it is never picked again
+    if(free_cells.empty())
+    fruit_pos = {-1 , -1};
+    else
+    fruit_pos = free_cells.pick(rng);
+    return true;
+}
+
+void drawFruit(Renderer& renderer , int score , COORD fruit_pos)
+{
+    drawScore(renderer , score);
+    if(fruit_pos.X >= 0)
+    renderer.put(fruit_pos , '*');
+}
+
+// Follows a Hamiltonian cycle over the playable cells and takes shortcuts
+// towards the fruit only while the whole body still lies behind the head
+// on the cycle, so the snake can never trap itself.
+struct Autopilot
+{
+    int width = 0;
+    int length = 0;
+    vector<int> order;  // position on the cycle, -1 for walls
+
+    // a cycle needs an even number of columns or rows
+    bool build()
     {
-        score++;
-        snake_length++;       
-        short x = x_min + (rand() % (x_max - x_min + 1));
-        short y = y_min + (rand() % (y_max - y_min + 1));
-        fruit_pos = {x , y};
+        width = COLUM + 1;
+        order.assign((size_t)width * (ROW + 1) , -1);
+        int w = COLUM - 2;
+        int h = ROW - 2;
+        length = w * h;
+        if(w < 2 || h < 2 || length % 2)
+        return false;
+
+        // serpentine through everything but the first column (or row),
+        // then return along it
+        int n = 0;
+        if(h % 2 == 0)
+        {
+            for(int y = 0; y < h; y++)
+            for(int i = 1; i < w; i++)
+            at(y % 2 ? w - i : i , y) = n++;
+            for(int y = h - 1; y >= 0; y--)
+            at(0 , y) = n++;
+        }
+        else
+        {
+            for(int x = 0; x < w; x++)
+            for(int i = 1; i < h; i++)
+            at(x , x % 2 ? h - i : i) = n++;
+            for(int x = w - 1; x >= 0; x--)
+            at(x , 0) = n++;
+        }
+        return true;
+    }
+
+    int& at(int x , int y)
+    {
+        return order[(size_t)(y + 2) * width + x + 1];
+    }
+
+    int orderOf(COORD c) const
+    {
+        return order[(size_t)c.Y * width + c.X];
+    }
+
+    int distance(int from , int to) const
+    {
+        return (to - from + length) % length;
+    }
+
+    char decide(const Snake& snake , COORD head , COORD fruit) const
+    {
+        int h = orderOf(head);
+        int tail = snake.body.length > 1 ? distance(h , orderOf(snake.body.tail())) : length;
+        int food = fruit.X >= 0 ? distance(h , orderOf(fruit)) : 0;
+        int empty = length - snake.length;
+
+        // keep a margin behind the tail, and stop cutting once the board
+        // is half full
+        int cut = tail - snake.length - 3;
+        if(empty < length / 2)
+        cut = 0;
+        else if(food < tail)
+        {
+            cut -= 1;
+            if((tail - food) * 4 > empty)
+            cut -= 10;
+        }
+        if(cut > food)
+        cut = food;
+
+        const char moves[4] = {'a' , 'd' , 'w' , 's'};
+        const short dx[4] = {-1 , 1 , 0 , 0};
+        const short dy[4] = {0 , 0 , -1 , 1};
+        char best = 0;
+        int bestDistance = -1;
+        char next = 0;
+        for(int i = 0; i < 4; i++)
+        {
+            COORD n = {(short)(head.X + dx[i]) , (short)(head.Y + dy[i])};
+            int o = orderOf(n);
+            if(o == -1)
+            continue;
+            int d = distance(h , o);
+            if(d == 1)
+            next = moves[i];
+            if(occupancy.test(n))
+            continue;
+            if(d <= cut && d > bestDistance)
+            {
+                best = moves[i];
+                bestDistance = d;
+            }
+        }
+        return best ? best : next;
+    }
+};
+
+// Many AI snakes on one board. Every tick each snake picks its next cell in
+// parallel against a board nobody is writing to; a serial pass in snake
+// order then moves the tails, settles heads that meet on one cell, and
+// moves the survivors. The result never depends on the thread count.
+class Arena
+{
+private:
+    static const int SPACE_LIMIT = 16;  // cells a move must open up to count as safe
+    static const int CHUNK = 32;        // snakes per parallel job
+
+    vector<Snake> snakes;
+    vector<COORD> intent;
+    vector<COORD> target;
+    vector<uint32_t> seeds;
+    vector<char> doomed;
+    vector<uint32_t> claim_tick;
+    vector<int> claim_by;
+    CellSet fruits;
+    int fruit_count;
+    uint32_t seed;
+    uint32_t tick = 0;
+    long long eaten = 0;
+    long long deaths = 0;
+    WorkerPool workers;
+
+    static uint32_t next(uint32_t& state)
+    {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+
+    size_t index(COORD c) const
+    {
+        return (size_t)c.Y * (COLUM + 1) + c.X;
+    }
+
+    static int manhattan(COORD a , COORD b)
+    {
+        return abs(a.X - b.X) + abs(a.Y - b.Y);
+    }
+
+    bool open(COORD c) const
+    {
+        return !wall(c) && !occupancy.test(c);
+    }
+
+    // free cells reachable from a move, counted up to SPACE_LIMIT
+    int space(COORD from) const
+    {
+        COORD seen[SPACE_LIMIT];
+        int count = 0;
+        seen[count++] = from;
+        for(int i = 0; i < count && count < SPACE_LIMIT; i++)
+        {
+            COORD n[4] = {{(short)(seen[i].X - 1) , seen[i].Y} , {(short)(seen[i].X + 1) , seen[i].Y} ,
+                          {seen[i].X , (short)(seen[i].Y - 1)} , {seen[i].X , (short)(seen[i].Y + 1)}};
+            for(int k = 0; k < 4 && count < SPACE_LIMIT; k++)
+            {
+                if(!open(n[k]))
+                continue;
+                bool known = false;
+                for(int j = 0; j < count && !known; j++)
+                known = seen[j].X == n[k].X && seen[j].Y == n[k].Y;
+                if(!known)
+                seen[count++] = n[k];
+            }
+        }
+        return count;
+    }
+
+    // a snake is dead between being killed and finding a free cell
+    bool alive(int i) const
+    {
+        return snakes[i].length > 0;
+    }
+
+    // reads the board only; runs on the workers
+    void decide(int i)
+    {
+        if(!alive(i))
+        return;
+        COORD head = snakes[i].body.segment(0);
+        if(!fruits.contains(target[i]) && !fruits.empty())
+        {
+            // nearest of a few random fruits
+            target[i] = fruits.at(next(seeds[i]) % fruits.size());
+            for(int k = 0; k < 3; k++)
+            {
+                COORD f = fruits.at(next(seeds[i]) % fruits.size());
+                if(manhattan(head , f) < manhattan(head , target[i]))
+                target[i] = f;
+            }
+        }
+
+        const short dx[4] = {-1 , 1 , 0 , 0};
+        const short dy[4] = {0 , 0 , -1 , 1};
+        COORD best = {(short)(head.X + 1) , head.Y};
+        int best_space = 0;
+        int best_distance = 0;
+        for(int k = 0; k < 4; k++)
+        {
+            COORD n = {(short)(head.X + dx[k]) , (short)(head.Y + dy[k])};
+            if(!open(n))
+            continue;
+            int s = space(n);
+            int d = manhattan(n , target[i]);
+            if(s > best_space || (s == best_space && d < best_distance))
+            {
+                best = n;
+                best_space = s;
+                best_distance = d;
+            }
+        }
+        intent[i] = best;
+    }
+
+    // on a full board the snake stays dead and tries again next tick
+    void spawn(int i)
+    {
+        if(free_cells.empty())
+        {
+            snakes[i].length = 0;
+            return;
+        }
+        spawnSnake(snakes[i] , free_cells.at(next(seed) % free_cells.size()));
+        target[i] = {0 , 0};
+    }
+
+    void kill(int i)
+    {
+        SnakeBody& body = snakes[i].body;
+        for(int k = 0; k < body.length; k++)
+        {
+            occupancy.clear(body.segment(k));
+            free_cells.add(body.segment(k));
+        }
+        body.length = 0;
+        snakes[i].length = 0;
+        deaths++;
+    }
+
+    void spawnFruits()
+    {
+        while(fruits.size() < fruit_count && !free_cells.empty())
+        {
+            COORD c = free_cells.at(next(seed) % free_cells.size());
+            free_cells.remove(c);
+            fruits.add(c);
+        }
+    }
+
+public:
+    Arena(int count , int fruit_count , unsigned threads , uint32_t seed)
+        : fruit_count(fruit_count) , seed(seed) , workers(threads , "arena worker")
+    {
+        resetBoard();
+        fruits.reset(COLUM + 1 , ROW + 1);
+        claim_tick.assign((size_t)(COLUM + 1) * (ROW + 1) , 0);
+        claim_by.assign(claim_tick.size() , -1);
+        snakes.resize(count);
+        intent.resize(count);
+        target.resize(count);
+        doomed.resize(count);
+        seeds.resize(count);
+        for(int i = 0; i < count; i++)
+        {
+            seeds[i] = seed ^ (uint32_t)(i * 2654435761u);
+            spawn(i);
+        }
+        spawnFruits();
+    }
+
+    void step()
+    {
+        tick++;
+        int count = (int)snakes.size();
+        workers.run((count + CHUNK - 1) / CHUNK , [&](int job)
+        {
+            int end = min(count , (job + 1) * CHUNK);
+            for(int i = job * CHUNK; i < end; i++)
+            decide(i);
+        });
+
+        for(int i = 0; i < count; i++)
+        {
+            if(alive(i))
+            vacateTail(snakes[i]);
+            doomed[i] = false;
+        }
+
+        // a head may not enter a body, and heads that meet all die
+        for(int i = 0; i < count; i++)
+        {
+            if(!alive(i))
+            continue;
+            COORD c = intent[i];
+            if(!open(c))
+            {
+                doomed[i] = true;
+                continue;
+            }
+            size_t cell = index(c);
+            if(claim_tick[cell] == tick)
+            {
+                doomed[i] = true;
+                doomed[claim_by[cell]] = true;
+                continue;
+            }
+            claim_tick[cell] = tick;
+            claim_by[cell] = i;
+        }
+
+        for(int i = 0; i < count; i++)
+        {
+            if(doomed[i] || !alive(i))
+            continue;
+            advanceHead(snakes[i] , intent[i]);
+            if(fruits.contains(intent[i]))
+            {
+                fruits.remove(intent[i]);
+                snakes[i].length++;
+                eaten++;
+            }
+        }
+
+        for(int i = 0; i < count; i++)
+        {
+            if(doomed[i])
+            kill(i);
+            if(!alive(i))
+            spawn(i);
+        }
+        spawnFruits();
+    }
+
+    int size() const
+    {
+        return (int)snakes.size();
+    }
+
+    unsigned getWorkers() const
+    {
+        return workers.size();
+    }
+
+    long long getEaten() const
+    {
+        return eaten;
+    }
+
+    long long getDeaths() const
+    {
+        return deaths;
+    }
+
+    int longest() const
+    {
+        int best = 0;
+        for(const Snake& s : snakes)
+        best = max(best , s.body.length);
+        return best;
+    }
+
+    // same board state gives the same value, for comparing thread counts
+    uint64_t checksum() const
+    {
+        uint64_t h = 1469598103934665603ull;
+        for(const Snake& s : snakes)
+        {
+            uint64_t head = s.length > 0 ? (uint64_t)index(s.body.segment(0)) : 0;
+            h = (h ^ head) * 1099511628211ull;
+            h = (h ^ (uint64_t)s.body.length) * 1099511628211ull;
+        }
+        return h;
+    }
+};
+
+// The scrolling world is far too big for a flat bitmap, so body and fruit
+// bits live in 64x64 chunks that only exist while something is in them.
+// Memory follows the snake's length, not the world's area.
+const int CHUNK_BITS = 6;
+const int CHUNK_SIZE = 1 << CHUNK_BITS;
+
+struct Chunk
+{
+    uint64_t body[CHUNK_SIZE] = {};
+    uint64_t fruit[CHUNK_SIZE] = {};
+    int used = 0;  // set bits of either kind
+};
+
+class World
+{
+private:
+    static const int FRUIT_RADIUS = 48;  // fruit stays this close to the head
+
+    int size;
+    unordered_map<uint32_t , Chunk*> chunks;
+    vector<COORD> fruits;
+    vector<COORD> changed;  // fruit cells added or removed since the last draw
+    uint32_t seed;
+
+    static uint32_t key(int cx , int cy)
+    {
+        return (uint32_t)cy << 16 | (uint32_t)cx;
+    }
+
+    static uint64_t bit(COORD c)
+    {
+        return uint64_t(1) << (c.X & (CHUNK_SIZE - 1));
+    }
+
+    static int row(COORD c)
+    {
+        return c.Y & (CHUNK_SIZE - 1);
+    }
+
+    Chunk* find(COORD c) const
+    {
+        auto it = chunks.find(key(c.X >> CHUNK_BITS , c.Y >> CHUNK_BITS));
+        return it == chunks.end() ? nullptr : it->second;
+    }
+
+    Chunk& touch(COORD c)
+    {
+        Chunk*& chunk = chunks[key(c.X >> CHUNK_BITS , c.Y >> CHUNK_BITS)];
+        if(!chunk)
+        chunk = new Chunk();
+        return *chunk;
+    }
+
+    void release(COORD c , Chunk* chunk)
+    {
+        if(--chunk->used > 0)
+        return;
+        delete chunk;
+        chunks.erase(key(c.X >> CHUNK_BITS , c.Y >> CHUNK_BITS));
+    }
+
+    int next()
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return (int)(seed >> 8);
+    }
+
+    // a few tries at a random free cell near the head; the world is mostly
+    // empty, so this is where a free-cell list cannot scale
+    COORD nearbyFreeCell(COORD head)
+    {
+        COORD c = head;
+        for(int tries = 0; tries < 16; tries++)
+        {
+            c.X = (short)(head.X + next() % (2 * FRUIT_RADIUS + 1) - FRUIT_RADIUS);
+            c.Y = (short)(head.Y + next() % (2 * FRUIT_RADIUS + 1) - FRUIT_RADIUS);
+            if(!wall(c) && !occupied(c) && !hasFruit(c))
+            return c;
+        }
+        return {-1 , -1};
+    }
+
+    void placeFruit(int i , COORD head)
+    {
+        COORD c = nearbyFreeCell(head);
+        fruits[i] = c;
+        if(c.X < 0)
+        return;
+        Chunk& chunk = touch(c);
+        chunk.fruit[row(c)] |= bit(c);
+        chunk.used++;
+        changed.push_back(c);
+    }
+
+    void removeFruit(int i)
+    {
+        COORD c = fruits[i];
+        if(c.X < 0)
+        return;
+        Chunk* chunk = find(c);
+        chunk->fruit[row(c)] &= ~bit(c);
+        release(c , chunk);
+        changed.push_back(c);
+    }
+
+public:
+    World(int size , int fruit_count , uint32_t seed) : size(size) , fruits(fruit_count , {-1 , -1}) , seed(seed)
+    {
+    }
+
+    ~World()
+    {
+        for(auto& entry : chunks)
+        delete entry.second;
     }
-    
-    SetConsoleCursorPosition(output , fruit_pos);
-    cout << '*';
-}
 
-void dead(bool& again)
+    int getSize() const
+    {
+        return size;
+    }
+
+    bool wall(COORD c) const
+    {
+        return c.X <= 0 || c.Y <= 0 || c.X >= size - 1 || c.Y >= size - 1;
+    }
+
+    bool occupied(COORD c) const
+    {
+        const Chunk* chunk = find(c);
+        return chunk && (chunk->body[row(c)] & bit(c));
+    }
+
+    bool hasFruit(COORD c) const
+    {
+        const Chunk* chunk = find(c);
+        return chunk && (chunk->fruit[row(c)] & bit(c));
+    }
+
+    const Chunk* chunkAt(int cx , int cy) const
+    {
+        auto it = chunks.find(key(cx , cy));
+        return it == chunks.end() ? nullptr : it->second;
+    }
+
+    void spawn(Snake& snake , COORD start)
+    {
+        snake.body.reset();
+        snake.length = 1;
+        snake.tail_moved = false;
+        snake.bit_itself = false;
+        advanceHead(snake , start);
+        for(int i = 0; i < (int)fruits.size(); i++)
+        if(fruits[i].X < 0)
+        placeFruit(i , start);
+    }
+
+    void remove(Snake& snake)
+    {
+        while(snake.body.length > 0)
+        {
+            COORD c = snake.body.tail();
+            Chunk* chunk = find(c);
+            chunk->body[row(c)] &= ~bit(c);
+            release(c , chunk);
+            snake.body.popTail();
+        }
+    }
+
+    void vacateTail(Snake& snake)
+    {
+        snake.tail_moved = snake.body.length >= snake.length;
+        if(!snake.tail_moved)
+        return;
+        COORD c = snake.last_position = snake.body.tail();
+        Chunk* chunk = find(c);
+        chunk->body[row(c)] &= ~bit(c);
+        release(c , chunk);
+        snake.body.popTail();
+    }
+
+    // a head that hits something is not written, so remove() stays exact
+    void advanceHead(Snake& snake , COORD head)
+    {
+        snake.bit_itself = wall(head) || occupied(head);
+        if(snake.bit_itself)
+        return;
+        Chunk& chunk = touch(head);
+        chunk.body[row(head)] |= bit(head);
+        chunk.used++;
+        snake.body.pushHead(head);
+    }
+
+    bool eat(Snake& snake)
+    {
+        COORD head = snake.body.segment(0);
+        if(!hasFruit(head))
+        return false;
+        for(int i = 0; i < (int)fruits.size(); i++)
+        if(eatFruit(head , fruits[i]))
+        {
+            removeFruit(i);
+            placeFruit(i , head);
+        }
+        snake.length++;
+        return true;
+    }
+
+    // fruit left far behind moves back near the head, so the chunks it
+    // holds do not pile up across the world
+    void keepFruitNear(COORD head)
+    {
+        for(int i = 0; i < (int)fruits.size(); i++)
+        {
+            COORD f = fruits[i];
+            if(f.X >= 0 && abs(f.X - head.X) <= FRUIT_RADIUS && abs(f.Y - head.Y) <= FRUIT_RADIUS)
+            continue;
+            removeFruit(i);
+            placeFruit(i , head);
+        }
+    }
+
+    const vector<COORD>& getFruits() const
+    {
+        return fruits;
+    }
+
+    vector<COORD>& getChanged()
+    {
+        return changed;
+    }
+
+    size_t chunkCount() const
+    {
+        return chunks.size();
+    }
+
+    size_t memoryBytes() const
+    {
+        return chunks.size() * (sizeof(Chunk) + sizeof(void*) * 4);
+    }
+};
+
+// The part of the world on screen. It jumps to re-centre on the head when
+// the head gets close to an edge; between jumps only changed cells are drawn.
+class Camera
 {
-    system("cls");
+private:
+    static const int MARGIN = 6;
+
+    int width;
+    int height;
+    int left = 0;
+    int top = 0;
+
+    char glyph(const World& world , const Snake& snake , COORD c) const
+    {
+        if(c.X < 0 || c.Y < 0 || c.X >= world.getSize() || c.Y >= world.getSize())
+        return ' ';
+        if(world.wall(c))
+        return '#';
+        if(world.hasFruit(c))
+        return '*';
+        if(world.occupied(c))
+        return eatFruit(c , snake.body.segment(0)) ? 'O' : 'o';
+        return ' ';
+    }
+
+public:
+    Camera(int width , int height) : width(width) , height(height)
+    {
+    }
+
+    bool visible(COORD c) const
+    {
+        return c.X >= left && c.X < left + width && c.Y >= top && c.Y < top + height;
+    }
+
+    // the top console row is left for the score
+    COORD toScreen(COORD c) const
+    {
+        return {(short)(c.X - left) , (short)(c.Y - top + 1)};
+    }
+
+    bool follow(COORD head)
+    {
+        if(head.X - left >= MARGIN && left + width - 1 - head.X >= MARGIN &&
+           head.Y - top >= MARGIN && top + height - 1 - head.Y >= MARGIN)
+        return false;
+        left = head.X - width / 2;
+        top = head.Y - height / 2;
+        return true;
+    }
+
+    void drawCell(Renderer& renderer , const World& world , const Snake& snake , COORD c) const
+    {
+        if(visible(c))
+        renderer.put(toScreen(c) , glyph(world , snake , c));
+    }
+
+    // blank rows, then the bits of the chunks under the view; chunks that
+    // do not exist are empty and cost nothing
+    void drawAll(Renderer& renderer , const World& world , const Snake& snake) const
+    {
+        vector<string> rows(height , string(width , ' '));
+        int last = world.getSize() - 1;
+        for(int y = 0; y < height; y++)
+        for(int x = 0; x < width; x++)
+        {
+            int wx = left + x;
+            int wy = top + y;
+            if((wx == 0 || wx == last) && wy >= 0 && wy <= last)
+            rows[y][x] = '#';
+            if((wy == 0 || wy == last) && wx >= 0 && wx <= last)
+            rows[y][x] = '#';
+        }
+
+        int first_cx = max(0 , left) >> CHUNK_BITS;
+        int first_cy = max(0 , top) >> CHUNK_BITS;
+        int last_cx = max(0 , left + width - 1) >> CHUNK_BITS;
+        int last_cy = max(0 , top + height - 1) >> CHUNK_BITS;
+        for(int cy = first_cy; cy <= last_cy; cy++)
+        for(int cx = first_cx; cx <= last_cx; cx++)
+        {
+            const Chunk* chunk = world.chunkAt(cx , cy);
+            if(!chunk)
+            continue;
+            for(int r = 0; r < CHUNK_SIZE; r++)
+            {
+                int y = (cy << CHUNK_BITS) + r - top;
+                if(y < 0 || y >= height)
+                continue;
+                uint64_t bits = chunk->body[r] | chunk->fruit[r];
+                for(int b = 0; b < CHUNK_SIZE && (bits >> b); b++)
+                {
+                    int x = (cx << CHUNK_BITS) + b - left;
+                    if(((bits >> b) & 1) && x >= 0 && x < width)
+                    rows[y][x] = (chunk->fruit[r] >> b) & 1 ? '*' : 'o';
+                }
+            }
+        }
+
+        for(int y = 0; y < height; y++)
+        renderer.text({0 , (short)(y + 1)} , rows[y]);
+        drawCell(renderer , world , snake , snake.body.segment(0));
+    }
+};
+
+void dead(bool& again , Renderer& renderer)
+{
+    renderer.clear();
+    renderer.flush();
     cout << "Dead\n";
     cout << "\nPlay Again ? Y/N : ";
     FlushConsoleInputBuffer(GetStdHandle(STD_INPUT_HANDLE));
@@ -159,45 +1159,376 @@ void dead(bool& again)
         default:
         break;
     }
-    system("cls");
     cin.ignore(numeric_limits<streamsize>::max(), '\n');
 }
 
-int main()
+void drawRound(Renderer& renderer , int score , COORD fruit_pos)
 {
+    renderer.clear();
+    drawMap(renderer);
+    drawScore(renderer , score);
+    renderer.put(fruit_pos , '*');
+    renderer.put(player.body.segment(0) , 'O');
+    renderer.flush();
+}
+
+// Plays with the autopilot as fast as possible and reports the cost of the
+// core tick.
+void benchmarkBot(int columns , int rows , int fruits)
+{
+    COLUM = columns;
+    ROW = rows;
+    Autopilot autopilot;
+    if(!autopilot.build())
+    {
+        cout << "no cycle on a " << COLUM - 2 << "x" << ROW - 2 << " board\n";
+        return;
+    }
+
+    rng.seed(12345);
+    COORD position = {3 , 2};
+    resetBoard();
+    spawnSnake(player , position);
+    COORD fruit_pos = free_cells.pick(rng);
+    int score = 0;
+    long long ticks = 0;
+    long long limit = (long long)fruits * autopilot.length;
+    bool died = false;
+
+    auto start = chrono::steady_clock::now();
+    while(score < fruits && ticks < limit)
+    {
+        UpdateFruit(player , score , fruit_pos);
+        if(fruit_pos.X < 0)
+        break;
+        moveDirection(player , autopilot.decide(player , position , fruit_pos) , position.X , position.Y);
+        ticks++;
+        if(collision(player , position))
+        {
+            died = true;
+            break;
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "board: " << COLUM - 2 << "x" << ROW - 2 << "\n";
+    cout << "fruits: " << score << (died ? " (died)" : fruit_pos.X < 0 ? " (board full)" : "") << "\n";
+    cout << "length: " << player.body.length << "\n";
+    cout << "ticks: " << ticks << "\n";
+    cout << "ticks/s: " << (long long)(ticks / seconds) << "\n";
+    cout << "moves/fruit: " << (score ? (double)ticks / score : 0.0) << "\n";
+}
+
+void benchmarkArena(int count , int size , int ticks , unsigned threads)
+{
+    COLUM = size;
+    ROW = size;
+    Arena arena(count , count * 2 , threads , 12345);
+
+    auto start = chrono::steady_clock::now();
+    for(int t = 0; t < ticks; t++)
+    arena.step();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "board: " << COLUM - 2 << "x" << ROW - 2 << "\n";
+    cout << "snakes: " << arena.size() << "\n";
+    cout << "workers: " << arena.getWorkers() << "\n";
+    cout << "ticks: " << ticks << "\n";
+    cout << "ticks/s: " << (long long)(ticks / seconds) << "\n";
+    cout << "fruits eaten: " << arena.getEaten() << "\n";
+    cout << "deaths: " << arena.getDeaths() << "\n";
+    cout << "longest: " << arena.longest() << "\n";
+    cout << "checksum: " << hex << arena.checksum() << dec << "\n";
+}
+
+// the open neighbour closest to the nearest fruit, or one step right when
+// every neighbour is blocked
+COORD steerToFruit(const World& world , COORD position)
+{
+    COORD target = position;
+    int nearest = numeric_limits<int>::max();
+    for(COORD f : world.getFruits())
+    {
+        int d = abs(f.X - position.X) + abs(f.Y - position.Y);
+        if(f.X >= 0 && d < nearest)
+        {
+            nearest = d;
+            target = f;
+        }
+    }
+
+    const short dx[4] = {-1 , 1 , 0 , 0};
+    const short dy[4] = {0 , 0 , -1 , 1};
+    COORD best = {(short)(position.X + 1) , position.Y};
+    int best_distance = numeric_limits<int>::max();
+    for(int k = 0; k < 4; k++)
+    {
+        COORD n = {(short)(position.X + dx[k]) , (short)(position.Y + dy[k])};
+        int d = abs(target.X - n.X) + abs(target.Y - n.Y);
+        if(!world.wall(n) && !world.occupied(n) && d < best_distance)
+        {
+            best = n;
+            best_distance = d;
+        }
+    }
+    return best;
+}
+
+void drawWorldStatus(Renderer& renderer , const World& world , int score)
+{
+    renderer.text({0 , 0} , "Score : " + to_string(score) + "   chunks : " + to_string(world.chunkCount()) + "    ");
+}
+
+// One snake in a world far bigger than the console, seen through a camera.
+void playWorld(int size)
+{
+    HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+    Renderer renderer(output);
+    CONSOLE_CURSOR_INFO cursorInfo;
+    GetConsoleCursorInfo(output, &cursorInfo); 
+    cursorInfo.bVisible = FALSE;                
+    SetConsoleCursorInfo(output, &cursorInfo);
+
+    bool again = true;
+    while(again)
+    {
+        World world(size , 64 , (uint32_t)time(NULL));
+        Snake snake;
+        COORD position = {(short)(size / 2) , (short)(size / 2)};
+        world.spawn(snake , position);
+        Camera camera(80 , 24);
+        camera.follow(position);
+        char move = 'd';
+        bool autoplay = false;
+        int score = 0;
+
+        renderer.clear();
+        camera.drawAll(renderer , world , snake);
+        drawWorldStatus(renderer , world , score);
+        renderer.flush();
+        world.getChanged().clear();
+        while(true)
+        {
+            control(move , autoplay);
+            world.vacateTail(snake);
+            if(autoplay)
+            {
+                COORD next = steerToFruit(world , position);
+                if(next.X != position.X)
+                move = next.X < position.X ? 'a' : 'd';
+                else
+                move = next.Y < position.Y ? 'w' : 's';
+            }
+            stepPosition(move , position.X , position.Y);
+            world.advanceHead(snake , position);
+            if(snake.bit_itself)
+            break;
+            if(world.eat(snake))
+            score++;
+            world.keepFruitNear(position);
+
+            if(camera.follow(position))
+            {
+                renderer.clear();
+                camera.drawAll(renderer , world , snake);
+            }
+            else
+            {
+                if(snake.tail_moved)
+                camera.drawCell(renderer , world , snake , snake.last_position);
+                if(snake.body.length > 1)
+                camera.drawCell(renderer , world , snake , snake.body.segment(1));
+                camera.drawCell(renderer , world , snake , position);
+                for(COORD c : world.getChanged())
+                camera.drawCell(renderer , world , snake , c);
+            }
+            world.getChanged().clear();
+            drawWorldStatus(renderer , world , score);
+            renderer.flush();
+            Sleep(100);
+        }
+        dead(again , renderer);
+    }
+}
+
+// Steers greedily at the nearest fruit and reports tick cost and how much
+// chunk memory the world holds against the snake's length.
+void benchmarkWorld(int ticks , int size)
+{
+    World world(size , 64 , 12345);
+    Snake snake;
+    COORD position = {(short)(size / 2) , (short)(size / 2)};
+    world.spawn(snake , position);
+    if(snake.body.length == 0)
+    {
+        cout << "world too small to spawn in\n";
+        return;
+    }
+    long long eaten = 0;
+    int deaths = 0;
+    size_t peak_chunks = 0;
+    int longest = 0;
+
+    auto start = chrono::steady_clock::now();
+    for(int t = 0; t < ticks; t++)
+    {
+        world.vacateTail(snake);
+        position = steerToFruit(world , position);
+        world.advanceHead(snake , position);
+        if(snake.bit_itself)
+        {
+            deaths++;
+            world.remove(snake);
+            // the body is gone, so only fruit can be in the way
+            position = {(short)(size / 2) , (short)(size / 2)};
+            while(!world.wall(position) && world.hasFruit(position))
+            position.X++;
+            world.spawn(snake , position);
+            if(snake.body.length == 0)
+            {
+                cout << "no free cell to respawn in after " << t << " ticks\n";
+                ticks = t + 1;
+                break;
+            }
+            continue;
+        }
+        eaten += world.eat(snake);
+        world.keepFruitNear(position);
+        world.getChanged().clear();
+        peak_chunks = max(peak_chunks , world.chunkCount());
+        longest = max(longest , snake.body.length);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "world: " << size << "x" << size << "\n";
+    cout << "ticks: " << ticks << "\n";
+    cout << "ticks/s: " << (long long)(ticks / seconds) << "\n";
+    cout << "fruits: " << eaten << "\n";
+    cout << "deaths: " << deaths << "\n";
+    cout << "length: " << snake.body.length << " (longest " << longest << ")\n";
+    cout << "chunks: " << world.chunkCount() << " (peak " << peak_chunks << ")\n";
+    cout << "chunk memory: " << world.memoryBytes() / 1024 << " KiB\n";
+}
+
+int main(int argc , char* argv[])
+{
+    // snake --world [size]
+    // snake --world-bench [ticks] [size]
+    if(argc > 1 && string(argv[1]) == "--world")
+    {
+        playWorld(argc > 2 ? min(32000 , atoi(argv[2])) : 32000);
+        return 0;
+    }
+    if(argc > 1 && string(argv[1]) == "--world-bench")
+    {
+        int ticks = argc > 2 ? atoi(argv[2]) : 1000000;
+        int size = argc > 3 ? min(32000 , atoi(argv[3])) : 32000;
+        benchmarkWorld(ticks , size);
+        return 0;
+    }
+
+    // snake --arena [snakes] [size] [ticks] [threads]
+    if(argc > 1 && string(argv[1]) == "--arena")
+    {
+        int count = argc > 2 ? atoi(argv[2]) : 500;
+        int size = argc > 3 ? atoi(argv[3]) : 1002;
+        int ticks = argc > 4 ? atoi(argv[4]) : 2000;
+        unsigned threads = argc > 5 ? (unsigned)atoi(argv[5]) : max(1u , thread::hardware_concurrency());
+        benchmarkArena(count , size , ticks , threads);
+        return 0;
+    }
+
+    // snake --bench [columns] [rows] [fruits]
+    if(argc > 1 && string(argv[1]) == "--bench")
+    {
+        int columns = argc > 2 ? atoi(argv[2]) : 1002;
+        int rows = argc > 3 ? atoi(argv[3]) : 1002;
+        int fruits = argc > 4 ? atoi(argv[4]) : 5000;
+        benchmarkBot(columns , rows , fruits);
+        return 0;
+    }
+
     HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+    Renderer renderer(output);
+    Autopilot autopilot;
+    bool autoplay = false;
+    bool can_autoplay = autopilot.build();
     COORD position = {3 , 2};
     
-    srand(time(NULL));
-    snake_position[0] = position;
+    rng.seed((unsigned)time(NULL));
+    resetBoard();
+    spawnSnake(player , position);
     int score = 0;
     char move = 'd';
     bool again = true;
     COORD fruit_pos = {5 , 7};
+
+    CONSOLE_CURSOR_INFO cursorInfo;
+    GetConsoleCursorInfo(output, &cursorInfo); 
+    cursorInfo.bVisible = FALSE;                
+    SetConsoleCursorInfo(output, &cursorInfo);
+    drawRound(renderer , score , fruit_pos);
+    size_t overlay_rows = 0;
     while(again)
     {
-        CONSOLE_CURSOR_INFO cursorInfo;
-        GetConsoleCursorInfo(output, &cursorInfo); 
-        cursorInfo.bVisible = FALSE;                
-        SetConsoleCursorInfo(output, &cursorInfo);
-        SetConsoleCursorPosition(output , {0 , 0});
-        cout << "Score : " << score << '\n';
-        control(move);
-        drawMap(output);
-        UpdateFruit(score , fruit_pos , output);
-        moveDirection(move , position.X , position.Y);
-        drawPlayer(output);
-        Sleep(150);
-
-        if(collision(position))
-        {
-            dead(again);
+        {
+            PROFILE_SCOPE(PHASE_INPUT);
+            control(move , autoplay);
+            if(GetAsyncKeyState(VK_F3) & 0b1)
+            Profiler::toggle();
+            if(GetAsyncKeyState(VK_F4) & 0b1)
+            Trace::write();
+        }
+        bool fruit_moved;
+        {
+            PROFILE_SCOPE(PHASE_UPDATE);
+            fruit_moved = UpdateFruit(player , score , fruit_pos);
+            if(autoplay && can_autoplay)
+            move = autopilot.decide(player , position , fruit_pos);
+            moveDirection(player , move , position.X , position.Y);
+        }
+        {
+            PROFILE_SCOPE(PHASE_DRAW);
+            if(fruit_moved)
+            drawFruit(renderer , score , fruit_pos);
+            drawPlayer(renderer , player);
+
+            // right of the board; hiding it blanks the rows it used
+            vector<string> overlay = Profiler::visible() ? Profiler::lines() : vector<string>();
+            for(size_t i = 0; i < overlay.size(); i++)
+            renderer.text({(short)(COLUM + 2) , (short)(i + 1)} , overlay[i]);
+            for(size_t i = overlay.size(); i < overlay_rows; i++)
+            renderer.text({(short)(COLUM + 2) , (short)(i + 1)} , string(48 , ' '));
+            overlay_rows = overlay.size();
+        }
+        {
+            PROFILE_SCOPE(PHASE_PRESENT);
+            renderer.flush();
+        }
+        {
+            PROFILE_SCOPE(PHASE_SLEEP);
+            Sleep(150);
+        }
+
+        bool hit;
+        {
+            PROFILE_SCOPE(PHASE_COLLISION);
+            hit = collision(player , position);
+        }
+        Profiler::collect();
+        TRACE_COUNTER("length" , player.length);
+        if(hit)
+        {
+            dead(again , renderer);
             position = {3 , 2};
-            snake_position[0] = position;
+            resetBoard();
+            spawnSnake(player , position);
             fruit_pos = {5 , 7};
             score = 0;
             move = 'd';
-            snake_length = 1;
+            if(again)
+            drawRound(renderer , score , fruit_pos);
         }
     }
+    Trace::write();
 }
@@ -15,7 +15,7 @@ public:
         previousKeys = currentKeys; // Save previous state
 
         // List of keys you want to monitor
-        int keys[] = {VK_LEFT, VK_RIGHT, VK_SPACE, 'A', 'D', 'W', 'S', VK_ESCAPE};
+        int keys[] = {VK_LEFT, VK_RIGHT, VK_SPACE, 'A', 'D', 'W', 'S', VK_ESCAPE, VK_F3, VK_F4};
 
         for (int key : keys)
         {
@@ -0,0 +1,317 @@
+#pragma once
+
+// Frame Profiler
+//
+// PROFILE_SCOPE(PHASE_UPDATE) times the rest of the enclosing block. Every
+// thread records into its own ring, and Profiler::collect(), called once a
+// frame from the game loop, folds all rings into per-phase histograms. The
+// overlay text is rebuilt once a second from the last second's histograms.
+// Each scope is also a span in the trace (see Trace.h). Build with
+// -DENGINE_PROFILER=0 and the histograms and overlay compile away.
+#include <string>
+#include <vector>
+#include <chrono>
+#include "Trace.h"
+
+#ifndef ENGINE_PROFILER
+#define ENGINE_PROFILER 1
+#endif
+
+enum ProfilePhase
+{
+    PHASE_INPUT,
+    PHASE_UPDATE,
+    PHASE_COLLISION,
+    PHASE_DRAW,    // rasterizing into the back buffer
+    PHASE_PRESENT, // handing the buffer to the console
+    PHASE_SLEEP,
+    PHASE_COUNT
+};
+
+#if ENGINE_PROFILER
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+// Durations in nanoseconds, in quarter-octave buckets: within 19% of the
+// true value, with the exact count, sum and max kept alongside.
+class ProfileHistogram
+{
+private:
+    static const int BUCKETS = 160;
+    uint32_t counts[BUCKETS] = {};
+
+    static int bucketOf(uint64_t ns)
+    {
+        if (ns < 8)
+            return (int)ns;
+        int msb = 63;
+        while (!(ns >> msb))
+            msb--;
+        int bucket = msb * 4 + (int)((ns >> (msb - 2)) & 3);
+        return bucket < BUCKETS ? bucket : BUCKETS - 1;
+    }
+
+    static uint64_t upperBound(int bucket)
+    {
+        if (bucket < 8)
+            return bucket;
+        int next = bucket + 1;
+        return (uint64_t)(4 + next % 4) << (next / 4 - 2);
+    }
+
+public:
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    void add(uint64_t ns)
+    {
+        counts[bucketOf(ns)]++;
+        count++;
+        sum += ns;
+        if (ns > max)
+            max = ns;
+    }
+
+    uint64_t percentile(double q) const
+    {
+        uint64_t rank = (uint64_t)(q * count);
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++)
+        {
+            seen += counts[i];
+            if (seen > rank)
+                return upperBound(i) < max ? upperBound(i) : max;
+        }
+        return max;
+    }
+
+    void reset()
+    {
+        *this = ProfileHistogram();
+    }
+};
+
+// One thread's samples. Only that thread writes; the collector reads up to
+// the published count. A sample is packed into one word so a slot is never
+// seen half written.
+class ProfileLog
+{
+private:
+    static const uint32_t CAPACITY = 4096;
+    std::atomic<uint64_t> samples[CAPACITY];
+    std::atomic<uint32_t> written{0};
+    uint32_t collected = 0;
+
+public:
+    void push(ProfilePhase phase, uint64_t ns)
+    {
+        uint32_t n = written.load(std::memory_order_relaxed);
+        samples[n % CAPACITY].store(ns << 8 | (uint64_t)phase, std::memory_order_relaxed);
+        written.store(n + 1, std::memory_order_release);
+    }
+
+    // samples older than one lap behind the writer are gone and skipped
+    template <class Fn>
+    void drain(Fn fn)
+    {
+        uint32_t end = written.load(std::memory_order_acquire);
+        if (end - collected > CAPACITY)
+            collected = end - CAPACITY;
+        for (; collected != end; collected++)
+        {
+            uint64_t word = samples[collected % CAPACITY].load(std::memory_order_relaxed);
+            fn((ProfilePhase)(word & 0xFF), word >> 8);
+        }
+    }
+};
+
+class Profiler
+{
+private:
+    struct State
+    {
+        std::mutex mutex; // guards logs and the histograms
+        std::vector<std::unique_ptr<ProfileLog>> logs;
+        ProfileHistogram phases[PHASE_COUNT];
+        ProfileHistogram frames;
+        std::chrono::steady_clock::time_point lastFrame = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point windowStart = lastFrame;
+        std::vector<std::string> lines;
+        bool visible = false;
+    };
+
+    static State &state()
+    {
+        static State s;
+        return s;
+    }
+
+    static std::string row(const char *name, const ProfileHistogram &h, uint64_t frames)
+    {
+        char text[64];
+        std::snprintf(text, sizeof(text), "%-9s %8.3f %7.3f %7.3f %7.3f", name,
+                      frames ? h.sum / 1e6 / frames : 0.0, h.percentile(0.5) / 1e6, h.percentile(0.99) / 1e6,
+                      h.max / 1e6);
+        return text;
+    }
+
+    static void rebuildLines(State &s)
+    {
+        static const char *names[PHASE_COUNT] = {"input", "update", "collide", "draw", "present", "sleep"};
+        s.lines.clear();
+        s.lines.push_back("phase     ms/frame     p50     p99     max");
+        for (int i = 0; i < PHASE_COUNT; i++)
+            s.lines.push_back(row(names[i], s.phases[i], s.frames.count));
+        s.lines.push_back(row("frame", s.frames, s.frames.count));
+        for (int i = 0; i < PHASE_COUNT; i++)
+            s.phases[i].reset();
+        s.frames.reset();
+    }
+
+public:
+    static ProfileLog &threadLog()
+    {
+        thread_local ProfileLog *log = nullptr;
+        if (!log)
+        {
+            State &s = state();
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.logs.push_back(std::unique_ptr<ProfileLog>(new ProfileLog));
+            log = s.logs.back().get();
+        }
+        return *log;
+    }
+
+    // once a frame, from the game loop
+    static void collect()
+    {
+        State &s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (auto &log : s.logs)
+            log->drain([&](ProfilePhase phase, uint64_t ns) { s.phases[phase].add(ns); });
+
+        auto now = std::chrono::steady_clock::now();
+        s.frames.add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - s.lastFrame).count());
+        s.lastFrame = now;
+        if (now - s.windowStart >= std::chrono::seconds(1))
+        {
+            rebuildLines(s);
+            s.windowStart = now;
+        }
+    }
+
+    static void toggle()
+    {
+        state().visible = !state().visible;
+    }
+
+    static bool visible()
+    {
+        return state().visible;
+    }
+
+    // the overlay as of the last full second, each line the same width
+    static std::vector<std::string> lines()
+    {
+        State &s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        return s.lines;
+    }
+
+    // the same table for everything since the last rebuild, for printing
+    // at the end of a run shorter than a second
+    static std::vector<std::string> snapshot()
+    {
+        collect();
+        State &s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        rebuildLines(s);
+        s.windowStart = s.lastFrame;
+        return s.lines;
+    }
+};
+
+#else
+
+class Profiler
+{
+public:
+    static void collect()
+    {
+    }
+
+    static void toggle()
+    {
+    }
+
+    static bool visible()
+    {
+        return false;
+    }
+
+    static std::vector<std::string> lines()
+    {
+        return {};
+    }
+
+    static std::vector<std::string> snapshot()
+    {
+        return {};
+    }
+};
+
+#endif
+
+#if ENGINE_PROFILER || ENGINE_TRACE
+
+// spans are named after the engine calls they usually wrap
+class ProfileScope
+{
+private:
+    ProfilePhase phase;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    ProfileScope(ProfilePhase phase) : phase(phase), start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~ProfileScope()
+    {
+        auto end = std::chrono::steady_clock::now();
+#if ENGINE_PROFILER
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        Profiler::threadLog().push(phase, (uint64_t)ns);
+#endif
+#if ENGINE_TRACE
+        static const char *names[PHASE_COUNT] = {"input", "update", "checkCollisions", "draw", "render", "sleep"};
+        Trace::span(names[phase], start, end);
+#endif
+    }
+};
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(phase) ProfileScope PROFILE_JOIN(profileScope, __LINE__)(phase)
+
+#else
+
+#define PROFILE_SCOPE(phase) ((void)0)
+
+#endif
+
+// For anything with Window's drawText(x, y, text, color).
+template <class Target>
+void drawProfilerOverlay(Target &target, int x, int y, unsigned short color = 7)
+{
+    if (!Profiler::visible())
+        return;
+    std::vector<std::string> lines = Profiler::lines();
+    for (size_t i = 0; i < lines.size(); i++)
+        target.drawText(x, y + (int)i, std::wstring(lines[i].begin(), lines[i].end()), color);
+}
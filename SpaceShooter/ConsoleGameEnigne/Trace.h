@@ -0,0 +1,200 @@
+#pragma once
+
+// Trace Recorder
+//
+// Keeps a timeline of spans and counters and writes it as Chrome trace-event
+// JSON, which chrome://tracing and ui.perfetto.dev both open. Every thread
+// appends fixed-size events to its own buffer, allocated up front and
+// reused as a ring, so a trace holds the newest events and recording costs
+// two clock reads and a store. Nothing is formatted until Trace::write.
+// Build with -DENGINE_TRACE=0 and all of it compiles away.
+#include <string>
+
+#ifndef ENGINE_TRACE
+#define ENGINE_TRACE 1
+#endif
+
+#if ENGINE_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// name must be a string literal; only the pointer is kept
+struct TraceEvent
+{
+    const char *name;
+    int64_t start; // ns since the trace began
+    int64_t value; // span length in ns, or the counter's value
+    char type;     // 'X' span, 'C' counter
+};
+
+class TraceBuffer
+{
+private:
+    static const uint32_t CAPACITY = 1 << 16;
+    std::unique_ptr<TraceEvent[]> events;
+    std::atomic<uint32_t> written{0};
+
+public:
+    int tid;
+    const char *threadName;
+
+    TraceBuffer(int tid, const char *threadName)
+        : events(new TraceEvent[CAPACITY]()), tid(tid), threadName(threadName)
+    {
+    }
+
+    void push(const char *name, char type, int64_t start, int64_t value)
+    {
+        uint32_t n = written.load(std::memory_order_relaxed);
+        events[n % CAPACITY] = {name, start, value, type};
+        written.store(n + 1, std::memory_order_release);
+    }
+
+    // oldest first; call when this thread is not recording, e.g. from the
+    // game loop between frames while the job threads wait
+    template <class Fn>
+    void forEach(Fn fn) const
+    {
+        uint32_t end = written.load(std::memory_order_acquire);
+        uint32_t begin = end > CAPACITY ? end - CAPACITY : 0;
+        for (uint32_t i = begin; i != end; i++)
+            fn(events[i % CAPACITY]);
+    }
+};
+
+// static initialisation runs on the main thread
+static const std::thread::id traceMainThread = std::this_thread::get_id();
+
+class Trace
+{
+private:
+    struct State
+    {
+        std::mutex mutex; // guards buffers
+        std::vector<std::unique_ptr<TraceBuffer>> buffers;
+        std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    };
+
+    static State &state()
+    {
+        static State s;
+        return s;
+    }
+
+public:
+    static TraceBuffer &threadBuffer()
+    {
+        thread_local TraceBuffer *buffer = nullptr;
+        if (!buffer)
+        {
+            State &s = state();
+            std::lock_guard<std::mutex> lock(s.mutex);
+            int tid = (int)s.buffers.size();
+            const char *name = std::this_thread::get_id() == traceMainThread ? "main" : "thread";
+            s.buffers.push_back(std::unique_ptr<TraceBuffer>(new TraceBuffer(tid, name)));
+            buffer = s.buffers.back().get();
+        }
+        return *buffer;
+    }
+
+    static int64_t since(std::chrono::steady_clock::time_point t)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t - state().epoch).count();
+    }
+
+    static void nameThread(const char *name)
+    {
+        threadBuffer().threadName = name;
+    }
+
+    static void span(const char *name, std::chrono::steady_clock::time_point start,
+                     std::chrono::steady_clock::time_point end)
+    {
+        int64_t from = since(start);
+        threadBuffer().push(name, 'X', from, since(end) - from);
+    }
+
+    static void counter(const char *name, int64_t value)
+    {
+        threadBuffer().push(name, 'C', since(std::chrono::steady_clock::now()), value);
+    }
+
+    static bool write(const std::string &path = "trace.json")
+    {
+        FILE *file = std::fopen(path.c_str(), "w");
+        if (!file)
+            return false;
+
+        State &s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        const char *separator = "";
+        std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        for (auto &buffer : s.buffers)
+        {
+            std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                         separator, buffer->tid, buffer->threadName, buffer->tid);
+            separator = ",\n";
+            buffer->forEach([&](const TraceEvent &e)
+            {
+                if (e.type == 'X')
+                    std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                                 e.name, buffer->tid, e.start / 1e3, e.value / 1e3);
+                else
+                    std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+                                 e.name, buffer->tid, e.start / 1e3, (long long)e.value);
+            });
+        }
+        std::fprintf(file, "\n]}\n");
+        std::fclose(file);
+        return true;
+    }
+};
+
+class TraceScope
+{
+private:
+    const char *name;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    TraceScope(const char *name) : name(name), start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~TraceScope()
+    {
+        Trace::span(name, start, std::chrono::steady_clock::now());
+    }
+};
+
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_JOIN(traceScope, __LINE__)(name)
+#define TRACE_COUNTER(name, value) Trace::counter(name, (int64_t)(value))
+
+#else
+
+class Trace
+{
+public:
+    static void nameThread(const char *)
+    {
+    }
+
+    static bool write(const std::string & = "trace.json")
+    {
+        return false;
+    }
+};
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+
+#endif
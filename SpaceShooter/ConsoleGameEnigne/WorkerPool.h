@@ -0,0 +1,110 @@
+#pragma once
+
+// Worker Pool
+//
+// Persistent threads that split a batch of jobs between them and the
+// calling thread. run() returns once every job is done, so whatever the
+// jobs wrote is visible to the caller afterwards. With one thread, run()
+// calls the jobs inline.
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include "Trace.h"
+
+class WorkerPool
+{
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable startSignal;
+    std::condition_variable doneSignal;
+    const std::function<void(int)> *job = nullptr;
+    int jobCount = 0;
+    std::atomic<int> nextJob{0};
+    unsigned generation = 0;
+    unsigned finished = 0;
+    bool stopping = false;
+
+    void drain()
+    {
+        int i;
+        while ((i = nextJob.fetch_add(1)) < jobCount)
+            (*job)(i);
+    }
+
+    void workerLoop(const char *name)
+    {
+        Trace::nameThread(name);
+        unsigned seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                startSignal.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+
+            {
+                TRACE_SCOPE("drain");
+                drain();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (++finished == threads.size())
+                doneSignal.notify_one();
+        }
+    }
+
+public:
+    // count includes the calling thread; name labels the workers in traces
+    WorkerPool(unsigned count, const char *name = "worker")
+    {
+        for (unsigned i = 1; i < count; i++)
+            threads.emplace_back(&WorkerPool::workerLoop, this, name);
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        startSignal.notify_all();
+        for (auto &t : threads)
+            t.join();
+    }
+
+    unsigned size() const
+    {
+        return (unsigned)threads.size() + 1;
+    }
+
+    void run(int count, const std::function<void(int)> &fn)
+    {
+        if (threads.empty())
+        {
+            for (int i = 0; i < count; i++)
+                fn(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            jobCount = count;
+            nextJob = 0;
+            finished = 0;
+            generation++;
+        }
+        startSignal.notify_all();
+
+        drain();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        doneSignal.wait(lock, [&] { return finished == threads.size(); });
+    }
+};
@@ -4,6 +4,7 @@
 #include <fstream>
 #include "ConsoleGameEnigne/Window.h"
 #include "ConsoleGameEnigne/InputHandler.h"
+#include "ConsoleGameEnigne/Profiler.h"
 #include <chrono>
 
 // Global Space
@@ -652,43 +653,73 @@ public:
             std::wstring scoreText;
             scoreText += L"Score: ";
             scoreText += std::to_wstring(score);
-            input.update();
+            {
+                PROFILE_SCOPE(PHASE_INPUT);
+                input.update();
+                if (input.isKeyPressed(VK_ESCAPE))
+                    break;
+                if (input.isKeyPressed(VK_F3))
+                    Profiler::toggle();
+                if (input.isKeyPressed(VK_F4))
+                    Trace::write();
+            }
 
             if (!player.isDeath())
             {
-                space.updateStars();
-                space.drawStars(buffer);
-                player.update(input);
-
-                for (auto &e : enemies)
                 {
-                    e->update();
-                }
+                    PROFILE_SCOPE(PHASE_UPDATE);
+                    space.updateStars();
+                    player.update(input);
 
-                spawnEnemies();
+                    for (auto &e : enemies)
+                    {
+                        e->update();
+                    }
 
-                checkCollisions();
+                    spawnEnemies();
+                }
 
-                for (auto &bullet : player.getBullets())
                 {
-                    window.draw(bullet->sprite, buffer, g_globalWidth * g_globalHeight);
+                    PROFILE_SCOPE(PHASE_COLLISION);
+                    checkCollisions();
                 }
 
-                for (auto &e : enemies)
                 {
-                    window.draw(e->sprite, buffer, g_globalWidth * g_globalHeight);
-                    for (auto &b : e->getBullets())
+                    PROFILE_SCOPE(PHASE_DRAW);
+                    space.drawStars(buffer);
+                    for (auto &bullet : player.getBullets())
+                    {
+                        window.draw(bullet->sprite, buffer, g_globalWidth * g_globalHeight);
+                    }
+
+                    for (auto &e : enemies)
                     {
-                        window.draw(b->sprite, buffer, g_globalWidth * g_globalHeight);
+                        window.draw(e->sprite, buffer, g_globalWidth * g_globalHeight);
+                        for (auto &b : e->getBullets())
+                        {
+                            window.draw(b->sprite, buffer, g_globalWidth * g_globalHeight);
+                        }
                     }
+
+                    window.draw(player.sprite, buffer, g_globalWidth * g_globalHeight);
+                    window.draw(buffer, g_globalWidth * g_globalHeight);
+                    window.drawText(0, 0, player.currentHealth());
+                    window.drawText(105, 0, scoreText);
+                    drawProfilerOverlay(window, 0, 1);
                 }
 
-                window.draw(player.sprite, buffer, g_globalWidth * g_globalHeight);
-                window.draw(buffer, g_globalWidth * g_globalHeight);
-                window.drawText(0, 0, player.currentHealth());
-                window.drawText(105, 0, scoreText);
-                window.render();
-                Sleep(50);
+                {
+                    PROFILE_SCOPE(PHASE_PRESENT);
+                    window.render();
+                }
+
+                {
+                    PROFILE_SCOPE(PHASE_SLEEP);
+                    Sleep(50);
+                }
+                Profiler::collect();
+                TRACE_COUNTER("enemies", enemies.size());
+                TRACE_COUNTER("player bullets", player.getBullets().size());
             }
             else
             {
@@ -703,6 +734,7 @@ public:
                 }
             }
         }
+        Trace::write();
     }
 };
 
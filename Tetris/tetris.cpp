@@ -5,6 +5,19 @@
 #include <utility>
 #include <chrono>
 #include <random>
+#include <thread>
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include "../SpaceShooter/ConsoleGameEnigne/Profiler.h"
+#include "../SpaceShooter/ConsoleGameEnigne/WorkerPool.h"
 
 const int nScreenWidth = 120;
 const int nScreenHeight = 35;
@@ -181,6 +194,26 @@ public:
         x = x + _x;
         y = y + _y;
     }
+
+    void rotate90Right()
+    {
+        // Assuming square grid
+        const int N = SHAPE_W;
+
+        // Step 1: Transpose the matrix
+        for (int i = 0; i < N; ++i)
+            for (int j = i + 1; j < N; ++j)
+                std::swap(blocks[i * N + j], blocks[j * N + i]);
+
+        // Step 2: Reverse each row
+        for (int i = 0; i < N; ++i)
+        {
+            for (int j = 0; j < N / 2; ++j)
+            {
+                std::swap(blocks[i * N + j], blocks[i * N + (N - 1 - j)]);
+            }
+        }
+    }
 };
 
 class GridSystem
@@ -196,6 +229,10 @@ private:
             grid[i] = 0;
             color_grid[i] = 0;
         }
+        for (int i = 0; i < height; i++)
+        {
+            dirty_rows[i] = true;
+        }
     }
 
     void drawBounds()
@@ -223,11 +260,13 @@ private:
 public:
     int *grid;
     WORD *color_grid;
+    bool *dirty_rows; // rows changed since the screen last rasterized them
 
     GridSystem(int _girdHeight, int _gridWidth) : height(_girdHeight), width(_gridWidth)
     {
         grid = new int[height * width];
         color_grid = new WORD[height * width];
+        dirty_rows = new bool[height];
         emptyGrid();
         drawBounds();
     }
@@ -236,6 +275,7 @@ public:
     {
         delete[] grid;
         delete[] color_grid;
+        delete[] dirty_rows;
     }
 
     int getHeight()
@@ -248,6 +288,57 @@ public:
         return width;
     }
 
+    void reset()
+    {
+        emptyGrid();
+        drawBounds();
+    }
+
+    // true when every block of the shape lands on an empty cell
+    bool fits(Shape &shape)
+    {
+        for (int r = 0; r < shape.getHeight(); ++r)
+        {
+            for (int c = 0; c < shape.getWidth(); ++c)
+            {
+                if (shape.blocks[r * SHAPE_W + c] != 0 &&
+                    grid[(shape.getY() + r) * width + (shape.getX() + c)] != 0)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Pushes the stack up and fills the bottom with rows that have a single
+    // gap. Anything pushed past the top row is lost.
+    void addGarbage(int lines, int holeColumn)
+    {
+        lines = std::min(lines, height - 1);
+
+        for (int i = 0; i < height - 1 - lines; i++)
+        {
+            for (int k = 1; k < width - 1; k++)
+            {
+                grid[i * width + k] = grid[(i + lines) * width + k];
+                color_grid[i * width + k] = color_grid[(i + lines) * width + k];
+            }
+        }
+
+        for (int i = height - 1 - lines; i < height - 1; i++)
+        {
+            for (int k = 1; k < width - 1; k++)
+            {
+                grid[i * width + k] = (k == holeColumn) ? 0 : 1;
+                color_grid[i * width + k] = (k == holeColumn) ? 0 : FOREGROUND_INTENSITY;
+            }
+        }
+
+        for (int i = 0; i < height; i++)
+        {
+            dirty_rows[i] = true;
+        }
+    }
+
     void placeShape(Shape shape)
     {
         for (int r = 0; r < shape.getHeight(); ++r)
@@ -260,6 +351,7 @@ public:
                 {
                     grid[grid_index] = shape.blocks[r * shape.getWidth() + c];
                     color_grid[grid_index] = shape.getColor();
+                    dirty_rows[shape.getY() + r] = true;
                 }
             }
         }
@@ -334,7 +426,9 @@ public:
                         grid[j * width + k] = grid[(j - 1) * width + k];
                         color_grid[j * width + k] = color_grid[(j - 1) * width + k];
                     }
+                    dirty_rows[j] = true;
                 }
+                dirty_rows[0] = true;
 
                 // Clear top row after shift
                 for (int k = 1; k < width - 1; k++)
@@ -370,6 +464,7 @@ public:
                     grid[i * width + j] = 2;
                     color_grid[i * width + j] = FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_RED;
                 }
+                dirty_rows[i] = true;
                 anyLineCleared++;
             }
         }
@@ -377,60 +472,541 @@ public:
     }
 };
 
+// Bot search board: one bitmask per interior row plus per-column counters
+// that are updated on every placed cell and cleared row, so evaluating a
+// placement never has to rescan the grid.
+class BotBoard
+{
+private:
+    static uint16_t shiftMask(uint16_t mask, int x)
+    {
+        // shape column c lands on grid column x + c, which is bit x + c - 1
+        return x >= 1 ? (uint16_t)(mask << (x - 1)) : (uint16_t)(mask >> (1 - x));
+    }
+
+    void addCell(int r, int c)
+    {
+        rows[r] |= (uint16_t)(1 << c);
+        if (r < top[c])
+        {
+            holes[c] += top[c] - r - 1;
+            top[c] = r;
+        }
+        else
+        {
+            holes[c]--; // filled a hole below the surface
+        }
+    }
+
+    void removeRow(int r)
+    {
+        std::memmove(&rows[1], &rows[0], r * sizeof(uint16_t));
+        rows[0] = 0;
+
+        for (int c = 0; c < COLS; c++)
+        {
+            if (top[c] < r)
+            {
+                top[c]++; // everything above shifts down, holes stay the same
+                continue;
+            }
+
+            // the removed row was the surface, so holes below it become open
+            int g = r + 1;
+            while (g < ROWS && (rows[g] & (1 << c)) == 0)
+                g++;
+            holes[c] -= g - r - 1;
+            top[c] = g;
+        }
+    }
+
+public:
+    static const int ROWS = GRID_HEIGHT - 1; // last grid row is the floor
+    static const int COLS = GRID_WIDTH - 2;  // columns between the walls
+    static const uint16_t FULL_ROW = (1 << COLS) - 1;
+
+    uint16_t rows[ROWS];
+    int top[COLS];   // first filled row of each column, ROWS when empty
+    int holes[COLS]; // empty cells below top
+
+    BotBoard()
+    {
+        for (int r = 0; r < ROWS; r++)
+            rows[r] = 0;
+        for (int c = 0; c < COLS; c++)
+        {
+            top[c] = ROWS;
+            holes[c] = 0;
+        }
+    }
+
+    void loadFrom(GridSystem &field)
+    {
+        for (int r = 0; r < ROWS; r++)
+        {
+            rows[r] = 0;
+            for (int c = 0; c < COLS; c++)
+            {
+                if (field.grid[r * field.getWidth() + (c + 1)] != 0)
+                    rows[r] |= (uint16_t)(1 << c);
+            }
+        }
+
+        for (int c = 0; c < COLS; c++)
+        {
+            top[c] = ROWS;
+            holes[c] = 0;
+            for (int r = ROWS - 1; r >= 0; r--)
+            {
+                if (rows[r] & (1 << c))
+                {
+                    holes[c] += top[c] - r - 1;
+                    top[c] = r;
+                }
+            }
+        }
+
+        // rows marked for clearing are still on the grid for one more frame
+        for (int r = 0; r < ROWS; r++)
+        {
+            if (rows[r] == FULL_ROW)
+                removeRow(r);
+        }
+    }
+
+    bool fits(const uint16_t shapeRows[], int minCol, int maxCol, int x, int y) const
+    {
+        if (x + minCol < 1 || x + maxCol > COLS)
+            return false;
+
+        for (int r = 0; r < SHAPE_H; r++)
+        {
+            if (shapeRows[r] == 0)
+                continue;
+            if (y + r >= ROWS || (rows[y + r] & shiftMask(shapeRows[r], x)) != 0)
+                return false;
+        }
+        return true;
+    }
+
+    // returns the number of cleared lines
+    int place(const uint16_t shapeRows[], int x, int y)
+    {
+        for (int r = 0; r < SHAPE_H; r++)
+        {
+            for (int c = 0; c < SHAPE_W; c++)
+            {
+                if (shapeRows[r] & (1 << c))
+                    addCell(y + r, x + c - 1);
+            }
+        }
+
+        int lines = 0;
+        for (int r = y; r < y + SHAPE_H && r < ROWS; r++)
+        {
+            if (rows[r] == FULL_ROW)
+            {
+                removeRow(r);
+                lines++;
+            }
+        }
+        return lines;
+    }
+
+    double evaluate(int lines) const
+    {
+        int aggregateHeight = 0;
+        int holeCount = 0;
+        int bumpiness = 0;
+
+        for (int c = 0; c < COLS; c++)
+        {
+            int h = ROWS - top[c];
+            aggregateHeight += h;
+            holeCount += holes[c];
+            if (c > 0)
+                bumpiness += std::abs(h - (ROWS - top[c - 1]));
+        }
+
+        return -0.510066 * aggregateHeight + 0.760666 * lines - 0.35663 * holeCount - 0.184483 * bumpiness;
+    }
+};
+
+struct BotPlacement
+{
+    int rotation; // number of rotate90Right calls, -1 when nothing fits
+    int x;
+    int y;
+};
+
+// Two-piece lookahead: every reachable drop of the current piece followed by
+// every reachable drop of the next one. First-level placements are split
+// across worker threads.
+class TetrisBot
+{
+private:
+    struct Piece
+    {
+        uint16_t rows[SHAPE_H];
+        int minCol;
+        int maxCol;
+    };
+
+    Piece pieces[8][4];
+    int rotations[8];
+    unsigned workers;
+    std::unique_ptr<WorkerPool> pool; // started on the first search
+    long long nodes;
+    double searchSeconds;
+
+    void buildPieces()
+    {
+        for (int type = 1; type <= 7; type++)
+        {
+            Shape shape(type, SHAPE_H, SHAPE_W);
+            // the O piece is never rotated by the game
+            rotations[type] = (type == 2) ? 1 : 4;
+
+            for (int k = 0; k < rotations[type]; k++)
+            {
+                Piece &piece = pieces[type][k];
+                piece.minCol = SHAPE_W;
+                piece.maxCol = -1;
+                for (int r = 0; r < SHAPE_H; r++)
+                {
+                    piece.rows[r] = 0;
+                    for (int c = 0; c < SHAPE_W; c++)
+                    {
+                        if (shape.blocks[r * SHAPE_W + c] != 0)
+                        {
+                            piece.rows[r] |= (uint16_t)(1 << c);
+                            piece.minCol = std::min(piece.minCol, c);
+                            piece.maxCol = std::max(piece.maxCol, c);
+                        }
+                    }
+                }
+                shape.rotate90Right();
+            }
+        }
+    }
+
+    void enumerate(const BotBoard &board, int type, std::vector<BotPlacement> &out) const
+    {
+        const int spawnX = GRID_WIDTH / 2;
+        out.clear();
+
+        for (int k = 0; k < rotations[type]; k++)
+        {
+            const Piece &piece = pieces[type][k];
+            if (!board.fits(piece.rows, piece.minCol, piece.maxCol, spawnX, 0))
+                continue;
+
+            // slide along the spawn row in both directions, then drop
+            for (int dir = -1; dir <= 1; dir += 2)
+            {
+                for (int x = (dir < 0) ? spawnX : spawnX + 1;
+                     board.fits(piece.rows, piece.minCol, piece.maxCol, x, 0); x += dir)
+                {
+                    int y = 0;
+                    while (board.fits(piece.rows, piece.minCol, piece.maxCol, x, y + 1))
+                        y++;
+                    out.push_back({k, x, y});
+                }
+            }
+        }
+    }
+
+public:
+    TetrisBot() : nodes(0), searchSeconds(0.0)
+    {
+        unsigned cores = std::thread::hardware_concurrency();
+        workers = cores > 0 ? cores : 1;
+        buildPieces();
+    }
+
+    const uint16_t *pieceRows(int type, int rotation) const
+    {
+        return pieces[type][rotation].rows;
+    }
+
+    BotPlacement choose(const BotBoard &board, int current, int next)
+    {
+        auto begin = std::chrono::high_resolution_clock::now();
+
+        std::vector<BotPlacement> first;
+        enumerate(board, current, first);
+        if (first.empty())
+            return {-1, 0, 0};
+
+        unsigned threadCount = std::min<unsigned>(workers, (unsigned)first.size());
+        std::vector<double> scores(first.size());
+        std::vector<long long> workerNodes(threadCount, 0);
+
+        std::function<void(int)> search = [&](int worker)
+        {
+            std::vector<BotPlacement> second;
+            long long count = 0;
+
+            for (size_t i = worker; i < first.size(); i += threadCount)
+            {
+                BotBoard afterFirst = board;
+                int lines = afterFirst.place(pieceRows(current, first[i].rotation), first[i].x, first[i].y);
+                count++;
+
+                enumerate(afterFirst, next, second);
+                double best = -1e9; // next piece cannot spawn
+                for (const BotPlacement &p : second)
+                {
+                    BotBoard afterSecond = afterFirst;
+                    int moreLines = afterSecond.place(pieceRows(next, p.rotation), p.x, p.y);
+                    best = std::max(best, afterSecond.evaluate(lines + moreLines));
+                    count++;
+                }
+                scores[i] = best;
+            }
+            workerNodes[worker] = count;
+        };
+
+        if (!pool)
+            pool.reset(new WorkerPool(workers, "bot worker"));
+        pool->run((int)threadCount, search);
+
+        // lowest index wins ties so the result does not depend on thread count
+        size_t best = 0;
+        for (size_t i = 1; i < first.size(); i++)
+        {
+            if (scores[i] > scores[best])
+                best = i;
+        }
+
+        for (long long n : workerNodes)
+            nodes += n;
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - begin;
+        searchSeconds += elapsed.count();
+
+        return first[best];
+    }
+
+    long long getNodes() const
+    {
+        return nodes;
+    }
+
+    double nodesPerSecond() const
+    {
+        return searchSeconds > 0.0 ? nodes / searchSeconds : 0.0;
+    }
+
+    unsigned getWorkers() const
+    {
+        return workers;
+    }
+
+    void setWorkers(unsigned count)
+    {
+        workers = count > 0 ? count : 1;
+        pool.reset();
+    }
+};
+
+// Turns the bot's chosen placement into one player move per step.
+class BotDriver
+{
+private:
+    BotPlacement plan;
+    int planRotations;
+
+public:
+    TetrisBot search;
+
+    BotDriver() : plan{-1, 0, 0}, planRotations(0) {}
+
+    void replan(GridSystem &field, int current, int next)
+    {
+        BotBoard board;
+        board.loadFrom(field);
+        plan = search.choose(board, current, next);
+        planRotations = plan.rotation;
+    }
+
+    void steer(Shape &shape, std::vector<int> collision)
+    {
+        if (plan.rotation < 0)
+            return;
+
+        if (planRotations > 0 && collision[3] == 0 && shape.getShapeType() != 2)
+        {
+            shape.rotate90Right();
+            planRotations--;
+        }
+        else if (shape.getX() < plan.x && collision[1] == 0)
+        {
+            shape.move(1, 0);
+        }
+        else if (shape.getX() > plan.x && collision[2] == 0)
+        {
+            shape.move(-1, 0);
+        }
+        else if (collision[0] == 0)
+        {
+            shape.move(0, 1);
+        }
+    }
+};
+
 class Screen
 {
 private:
     int width;
     int height;
-    wchar_t *screen_buffer;
-    WORD *color_buffer;
+    CHAR_INFO *buffer;
+    bool *dirty;
     HANDLE hConsole;
-    DWORD dwBytesWritten;
+    int pieceTop;    // rows covered by the piece drawn last frame
+    int pieceBottom;
+
+    void setCell(int index, wchar_t ch, WORD color)
+    {
+        buffer[index].Char.UnicodeChar = ch;
+        buffer[index].Attributes = color;
+    }
+
+    void rasterizeRow(GridSystem &field, int row, int offsetX, int offsetY, wchar_t blockTexture, wchar_t markTexture)
+    {
+        for (int j = 0; j < field.getWidth(); j++)
+        {
+            int grid_index = row * field.getWidth() + j;
+            int screen_index = (offsetY + row) * width + (offsetX + j);
+
+            if (field.grid[grid_index] == 1)
+                setCell(screen_index, blockTexture, field.color_grid[grid_index]);
+            else if (field.grid[grid_index] == 2)
+                setCell(screen_index, markTexture, field.color_grid[grid_index]);
+            else
+                setCell(screen_index, L' ', FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE);
+        }
+        field.dirty_rows[row] = false;
+    }
 
 public:
-    Screen(int screenWidth,int screenHeight ) : width(screenWidth), height(screenHeight)
+    // headless screens keep the buffer but never touch the console
+    Screen(int screenWidth,int screenHeight, bool headless = false) : width(screenWidth), height(screenHeight)
     {
-        screen_buffer = new wchar_t[height * width];
-        color_buffer = new WORD[height * width];
-        hConsole = CreateConsoleScreenBuffer(GENERIC_READ | GENERIC_WRITE, 0, NULL, CONSOLE_TEXTMODE_BUFFER, NULL);
-        SetConsoleActiveScreenBuffer(hConsole);
-        dwBytesWritten = 0;
+        buffer = new CHAR_INFO[height * width];
+        dirty = new bool[height];
+        hConsole = NULL;
+        if (!headless)
+        {
+            hConsole = CreateConsoleScreenBuffer(GENERIC_READ | GENERIC_WRITE, 0, NULL, CONSOLE_TEXTMODE_BUFFER, NULL);
+            // shrink the window first, since the buffer may not be made
+            // smaller than it, then fit both to the screen
+            SMALL_RECT tiny = {0, 0, 0, 0};
+            SetConsoleWindowInfo(hConsole, TRUE, &tiny);
+            SetConsoleScreenBufferSize(hConsole, {(SHORT)width, (SHORT)height});
+            SMALL_RECT window = {0, 0, (SHORT)(width - 1), (SHORT)(height - 1)};
+            SetConsoleWindowInfo(hConsole, TRUE, &window);
+            SetConsoleActiveScreenBuffer(hConsole);
+        }
+        pieceTop = 0;
+        pieceBottom = -1;
         clearScreen();
     }
 
     ~Screen()
     {
-        delete[] screen_buffer;
-        delete[] color_buffer;
+        delete[] buffer;
+        delete[] dirty;
     }
 
     void clearScreen()
     {
         for (int i = 0; i < height * width; i++)
         {
-            screen_buffer[i] = L' ';
-            color_buffer[i] = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+            setCell(i, L' ', FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE);
+        }
+        for (int i = 0; i < height; i++)
+        {
+            dirty[i] = true;
         }
     }
 
-    void draw(GridSystem &field, int target, wchar_t texture = L'*')
+    // Re-rasterizes only the field rows that changed, plus the rows the
+    // active piece covered last frame so its old footprint gets erased.
+    void draw(GridSystem &field, wchar_t blockTexture = L'\u2588', wchar_t markTexture = L'*')
     {
+        for (int i = pieceTop; i <= pieceBottom; i++)
+        {
+            field.dirty_rows[i] = true;
+        }
+        pieceBottom = -1;
+
         for (int i = 0; i < field.getHeight(); i++)
         {
-            for (int j = 0; j < field.getWidth(); j++)
-            {
-                int grid_index = i * field.getWidth() + j;
+            if (!field.dirty_rows[i])
+                continue;
 
-                if (field.grid[grid_index] == target)
+            rasterizeRow(field, i, 0, 0, blockTexture, markTexture);
+            dirty[i] = true;
+        }
+    }
+
+    // Composites one board into its own tile. Safe to call from several
+    // threads as long as the tiles do not overlap: it leaves the screen's
+    // dirty flags alone and returns the tile rows it rewrote instead.
+    uint32_t drawBoard(GridSystem &field, Shape &shape, int offsetX, int offsetY,
+                       wchar_t blockTexture = L'\u2588', wchar_t markTexture = L'*')
+    {
+        uint32_t rows = 0;
+        for (int i = 0; i < field.getHeight(); i++)
+        {
+            if (!field.dirty_rows[i])
+                continue;
+
+            rasterizeRow(field, i, offsetX, offsetY, blockTexture, markTexture);
+            rows |= 1u << i;
+        }
+
+        for (int i = 0; i < shape.getHeight(); i++)
+        {
+            for (int j = 0; j < shape.getWidth(); j++)
+            {
+                if (shape.blocks[i * shape.getWidth() + j] != 0)
                 {
-                    int screen_index = i * width + j;
-                    screen_buffer[screen_index] = texture;
-                    color_buffer[screen_index] = field.color_grid[grid_index];
+                    int gy = shape.getY() + i;
+                    setCell((offsetY + gy) * width + (offsetX + shape.getX() + j), L'#', shape.getColor());
+                    field.dirty_rows[gy] = true; // erase the piece next frame
+                    rows |= 1u << gy;
                 }
             }
         }
+        return rows;
     }
 
+    // writes text without flagging the row, see drawBoard
+    void writeText(const std::string &message, int x, int y, WORD color = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE)
+    {
+        for (int i = 0; i < message.size() && x + i < width; i++)
+        {
+            setCell(y * width + (x + i), message[i], color);
+        }
+    }
+
+    void markDirty(int y)
+    {
+        dirty[y] = true;
+    }
+
+    int getWidth()
+    {
+        return width;
+    }
+
+    int getHeight()
+    {
+        return height;
+    }
+
+    // Call after draw(GridSystem&) so the piece is painted over the field.
     void draw(Shape shape, wchar_t texture = L'*')
     {
         for (int i = 0; i < shape.getHeight(); i++)
@@ -441,9 +1017,13 @@ public:
                 {
                     int gx = shape.getX() + j;
                     int gy = shape.getY() + i;
-                    int index = gy * width + gx;
-                    screen_buffer[index] = texture;
-                    color_buffer[index] = shape.getColor();
+                    setCell(gy * width + gx, texture, shape.getColor());
+
+                    if (pieceBottom < pieceTop)
+                        pieceTop = pieceBottom = gy;
+                    pieceTop = std::min(pieceTop, gy);
+                    pieceBottom = std::max(pieceBottom, gy);
+                    dirty[gy] = true;
                 }
             }
         }
@@ -454,15 +1034,441 @@ public:
         y += GRID_HEIGHT;
         for (int i = 0; i < message.size(); i++)
         {
-            screen_buffer[y * width + (x + i)] = message[i];
+            int index = y * width + (x + i);
+            if (buffer[index].Char.UnicodeChar != (wchar_t)message[i])
+            {
+                buffer[index].Char.UnicodeChar = message[i];
+                dirty[y] = true;
+            }
         }
     }
 
+    void clearLine(int y)
+    {
+        print(std::string(width, ' '), 0, y);
+    }
+
+    // Sends each run of consecutive dirty rows with a single console call.
     void render()
     {
-        WriteConsoleOutputCharacterW(hConsole, screen_buffer, height * width, {0, 0}, &dwBytesWritten);
-        WriteConsoleOutputAttribute(hConsole, color_buffer, width * height, {0, 0}, &dwBytesWritten);
-        clearScreen();
+        if (hConsole == NULL)
+        {
+            for (int i = 0; i < height; i++)
+                dirty[i] = false;
+            return;
+        }
+
+        int row = 0;
+        while (row < height)
+        {
+            if (!dirty[row])
+            {
+                row++;
+                continue;
+            }
+
+            int first = row;
+            while (row < height && dirty[row])
+            {
+                dirty[row] = false;
+                row++;
+            }
+
+            COORD size = {(SHORT)width, (SHORT)(row - first)};
+            SMALL_RECT region = {0, (SHORT)first, (SHORT)(width - 1), (SHORT)(row - 1)};
+            WriteConsoleOutputW(hConsole, buffer + first * width, size, {0, 0}, &region);
+        }
+    }
+};
+
+struct Garbage
+{
+    int lines;
+    int holeColumn;
+};
+
+// Single-producer single-consumer ring: the opponent pushes from its worker
+// thread while the owner pops from its own.
+class GarbageQueue
+{
+private:
+    static const unsigned CAPACITY = 64;
+    Garbage items[CAPACITY];
+    std::atomic<unsigned> head{0}; // written by the consumer
+    std::atomic<unsigned> tail{0}; // written by the producer
+
+public:
+    bool push(Garbage garbage)
+    {
+        unsigned t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == CAPACITY)
+            return false;
+        items[t % CAPACITY] = garbage;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    unsigned published() const
+    {
+        return tail.load(std::memory_order_acquire);
+    }
+
+    // only pops entries published before limit, so what a board receives
+    // does not depend on how the workers were scheduled
+    bool pop(unsigned limit, Garbage &garbage)
+    {
+        unsigned h = head.load(std::memory_order_relaxed);
+        if (h == limit)
+            return false;
+        garbage = items[h % CAPACITY];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // not thread safe, only between ticks
+    void clear()
+    {
+        head.store(0);
+        tail.store(0);
+    }
+};
+
+enum BoardInput
+{
+    INPUT_NONE,
+    INPUT_LEFT,
+    INPUT_RIGHT,
+    INPUT_DOWN,
+    INPUT_ROTATE
+};
+
+// One independent player: field, falling piece, its own RNG and bot.
+// Everything is advanced in ticks so a board only ever touches its own
+// state and its opponent's garbage queue.
+class BattleBoard
+{
+private:
+    GridSystem grid;
+    Shape shape;
+    int nextShapeType;
+    std::mt19937 gen;
+    BotDriver bot;
+    bool human;
+    int tick;
+    unsigned garbageLimit;
+
+    int nextType()
+    {
+        return 1 + (int)(gen() % 7);
+    }
+
+    void spawn()
+    {
+        shape = Shape(nextShapeType, SHAPE_H, SHAPE_W);
+        shape.setPosition(GRID_WIDTH / 2, 0);
+        shape.setColor((WORD)(1 + gen() % 6)); // same colours as randomColor, without its shared RNG
+        nextShapeType = nextType();
+
+        if (!grid.fits(shape))
+        {
+            gameOver = true;
+            return;
+        }
+        if (!human)
+            bot.replan(grid, shape.getShapeType(), nextShapeType);
+    }
+
+    void lockPiece()
+    {
+        grid.placeShape(shape);
+        int cleared = grid.markLines();
+        grid.clearLines();
+        lines += cleared;
+
+        if (cleared >= 2 && opponent != nullptr)
+        {
+            Garbage garbage = {cleared - 1, 1 + (int)(gen() % (GRID_WIDTH - 2))};
+            if (opponent->incoming.push(garbage))
+                sent += garbage.lines;
+        }
+
+        Garbage garbage;
+        while (incoming.pop(garbageLimit, garbage))
+            grid.addGarbage(garbage.lines, garbage.holeColumn);
+
+        spawn();
+    }
+
+    void applyInput(int input, std::vector<int> collision)
+    {
+        if (input == INPUT_LEFT && collision[2] == 0)
+            shape.move(-1, 0);
+        else if (input == INPUT_RIGHT && collision[1] == 0)
+            shape.move(1, 0);
+        else if (input == INPUT_DOWN && collision[0] == 0)
+            shape.move(0, 1);
+        else if (input == INPUT_ROTATE && collision[3] == 0 && shape.getShapeType() != 2)
+            shape.rotate90Right();
+    }
+
+public:
+    static const int FALL_TICKS = 20;
+
+    GarbageQueue incoming;
+    BattleBoard *opponent;
+    int lines;
+    int sent;
+    int wins;
+    bool gameOver;
+
+    BattleBoard(unsigned seed, bool _human)
+        : grid(GRID_HEIGHT, GRID_WIDTH), gen(seed), human(_human), opponent(nullptr), wins(0)
+    {
+        bot.search.setWorkers(1); // boards already run in parallel
+        reset();
+    }
+
+    // not thread safe, only between ticks
+    void reset()
+    {
+        grid.reset();
+        incoming.clear();
+        garbageLimit = 0;
+        tick = 0;
+        lines = 0;
+        sent = 0;
+        gameOver = false;
+        nextShapeType = nextType();
+        spawn();
+    }
+
+    // called on the main thread between ticks
+    void snapshotGarbage()
+    {
+        garbageLimit = incoming.published();
+    }
+
+    void update(int input)
+    {
+        if (gameOver)
+            return;
+
+        tick++;
+        if (human)
+            applyInput(input, grid.collision(shape));
+        else
+            bot.steer(shape, grid.collision(shape));
+
+        if (tick % FALL_TICKS == 0)
+        {
+            if (grid.collision(shape)[0] != 0)
+                lockPiece();
+            else
+                shape.move(0, 1);
+        }
+        else if (!human && grid.collision(shape)[0] != 0)
+        {
+            lockPiece(); // the bot has nothing left to adjust
+        }
+    }
+
+    uint32_t draw(Screen &screen, int offsetX, int offsetY)
+    {
+        uint32_t rows = screen.drawBoard(grid, shape, offsetX, offsetY);
+
+        std::string status = gameOver ? "TOPPED OUT   " : "L" + std::to_string(lines) + " W" + std::to_string(wins) + "      ";
+        screen.writeText(status.substr(0, GRID_WIDTH), offsetX, offsetY + GRID_HEIGHT);
+        return rows | (1u << GRID_HEIGHT);
+    }
+};
+
+// Versus / spectator mode: boards are paired 0-1, 2-3, ... and all of them
+// are updated and composited in parallel every tick.
+class BattleMode
+{
+private:
+    static const int TILE_W = GRID_WIDTH + 2;
+    static const int TILE_H = GRID_HEIGHT + 2;
+
+    std::vector<BattleBoard *> boards;
+    std::vector<uint32_t> boardRows;
+    WorkerPool workers;
+    Screen *screen;
+    int columns;
+    bool humanPlayer;
+    int boardInput;
+
+    int readInput()
+    {
+        if (GetAsyncKeyState('A') & 0b1)
+            return INPUT_LEFT;
+        if (GetAsyncKeyState('D') & 0b1)
+            return INPUT_RIGHT;
+        if (GetAsyncKeyState('S') & 0b1)
+            return INPUT_DOWN;
+        if (GetAsyncKeyState(VK_SPACE) & 0b1)
+            return INPUT_ROTATE;
+        return INPUT_NONE;
+    }
+
+    void settleMatches()
+    {
+        for (size_t i = 0; i < boards.size(); i += 2)
+        {
+            BattleBoard *a = boards[i];
+            BattleBoard *b = (i + 1 < boards.size()) ? boards[i + 1] : nullptr;
+
+            if (b == nullptr)
+            {
+                if (a->gameOver)
+                    a->reset();
+                continue;
+            }
+            if (!a->gameOver && !b->gameOver)
+                continue;
+
+            if (!a->gameOver)
+                a->wins++;
+            if (!b->gameOver)
+                b->wins++;
+            a->reset();
+            b->reset();
+        }
+    }
+
+public:
+    BattleMode(int boardCount, bool human, bool headless)
+        : workers(std::max(1u, std::thread::hardware_concurrency()), "board worker"), humanPlayer(human), boardInput(INPUT_NONE)
+    {
+        boardCount = std::max(boardCount, human ? 2 : 1);
+        columns = (int)std::ceil(std::sqrt((double)boardCount));
+
+        // a console shows only so many tiles; drop the boards that would
+        // fall outside the largest window it can open
+        COORD largest = headless ? COORD{0, 0} : GetLargestConsoleWindowSize(GetStdHandle(STD_OUTPUT_HANDLE));
+        int maxColumns = largest.X / TILE_W;
+        int maxRows = (largest.Y - 1) / TILE_H;
+        if (maxColumns > 0 && maxRows > 0)
+        {
+            boardCount = std::min(boardCount, maxColumns * maxRows);
+            columns = std::min(std::max(columns, (boardCount + maxRows - 1) / maxRows), maxColumns);
+        }
+
+        int rows = (boardCount + columns - 1) / columns;
+        screen = new Screen(columns * TILE_W, rows * TILE_H + 1, headless);
+
+        for (int i = 0; i < boardCount; i++)
+        {
+            boards.push_back(new BattleBoard(1000 + i, human && i == 0));
+        }
+        for (int i = 0; i + 1 < boardCount; i += 2)
+        {
+            boards[i]->opponent = boards[i + 1];
+            boards[i + 1]->opponent = boards[i];
+        }
+        boardRows.resize(boardCount, 0);
+    }
+
+    ~BattleMode()
+    {
+        for (auto board : boards)
+            delete board;
+        delete screen;
+    }
+
+    // Runs until ESC, or for maxTicks ticks when maxTicks > 0. A headless
+    // run does not sleep and prints its frame times at the end.
+    void run(int maxTicks, bool headless)
+    {
+        const float frameBudget = 1.0f / 60.0f;
+        double totalSeconds = 0.0;
+        double worstSeconds = 0.0;
+        int ticks = 0;
+
+        // runs on the worker threads, which profile into their own logs
+        std::function<void(int)> step = [&](int i)
+        {
+            {
+                PROFILE_SCOPE(PHASE_UPDATE);
+                boards[i]->update(i == 0 ? boardInput : INPUT_NONE);
+            }
+            PROFILE_SCOPE(PHASE_DRAW);
+            boardRows[i] = boards[i]->draw(*screen, (i % columns) * TILE_W, (i / columns) * TILE_H);
+        };
+
+        while (maxTicks <= 0 || ticks < maxTicks)
+        {
+            auto frameStart = std::chrono::high_resolution_clock::now();
+
+            if (!headless && (GetAsyncKeyState(VK_ESCAPE) & 0x8000))
+                break;
+            {
+                PROFILE_SCOPE(PHASE_INPUT);
+                boardInput = humanPlayer ? readInput() : INPUT_NONE;
+                if (!headless && (GetAsyncKeyState(VK_F4) & 0b1))
+                    Trace::write();
+            }
+
+            for (auto board : boards)
+                board->snapshotGarbage();
+
+            workers.run((int)boards.size(), step);
+
+            for (size_t i = 0; i < boards.size(); i++)
+            {
+                int offsetY = ((int)i / columns) * TILE_H;
+                for (int r = 0; r < TILE_H; r++)
+                {
+                    if (boardRows[i] & (1u << r))
+                        screen->markDirty(offsetY + r);
+                }
+            }
+            {
+                PROFILE_SCOPE(PHASE_UPDATE);
+                settleMatches();
+            }
+
+            std::chrono::duration<double> work = std::chrono::high_resolution_clock::now() - frameStart;
+            totalSeconds += work.count();
+            worstSeconds = std::max(worstSeconds, work.count());
+            ticks++;
+
+            if (ticks % 30 == 0)
+            {
+                std::string stats = "boards " + std::to_string(boards.size()) +
+                                    "  workers " + std::to_string(workers.size()) +
+                                    "  frame ms avg " + std::to_string(totalSeconds * 1000.0 / ticks).substr(0, 5) +
+                                    " max " + std::to_string(worstSeconds * 1000.0).substr(0, 5) + "      ";
+                screen->writeText(stats, 0, screen->getHeight() - 1);
+                screen->markDirty(screen->getHeight() - 1);
+            }
+            {
+                PROFILE_SCOPE(PHASE_PRESENT);
+                screen->render();
+            }
+
+            if (!headless && work.count() < frameBudget)
+            {
+                PROFILE_SCOPE(PHASE_SLEEP);
+                Sleep((DWORD)((frameBudget - work.count()) * 1000.0f));
+            }
+            Profiler::collect();
+            TRACE_COUNTER("frame work us", work.count() * 1e6);
+        }
+
+        if (!headless)
+            Trace::write();
+        if (headless)
+        {
+            std::cout << "boards: " << boards.size() << "\n";
+            std::cout << "workers: " << workers.size() << "\n";
+            std::cout << "ticks: " << ticks << "\n";
+            std::cout << "frame ms avg: " << totalSeconds * 1000.0 / std::max(1, ticks) << "\n";
+            std::cout << "frame ms max: " << worstSeconds * 1000.0 << "\n";
+            std::cout << "budget ms: " << frameBudget * 1000.0f << "\n";
+            for (const std::string &line : Profiler::snapshot())
+                std::cout << line << "\n";
+        }
     }
 };
 
@@ -472,6 +1478,12 @@ private:
     Shape *shape;
     GridSystem *grid;
     Screen *screen;
+    BotDriver bot;
+    int nextShapeType;
+    bool autoPlay;
+    // the bot plans from a freshly spawned piece, so P hands over at the
+    // next spawn rather than mid-fall
+    bool autoPlayPending;
 
     void control(Shape &shape, std::vector<int> collision)
     {
@@ -493,27 +1505,7 @@ private:
         }
         else if (((GetAsyncKeyState)(VK_SPACE) & 0b1) && (collision[3] == 0) && (shape.getShapeType() != 2))
         {
-            rotate90Right(shape);
-        }
-    }
-
-    void rotate90Right(Shape &shape)
-    {
-        // Assuming square grid
-        const int N = SHAPE_W;
-
-        // Step 1: Transpose the matrix
-        for (int i = 0; i < N; ++i)
-            for (int j = i + 1; j < N; ++j)
-                std::swap(shape.blocks[i * N + j], shape.blocks[j * N + i]);
-
-        // Step 2: Reverse each row
-        for (int i = 0; i < N; ++i)
-        {
-            for (int j = 0; j < N / 2; ++j)
-            {
-                std::swap(shape.blocks[i * N + j], shape.blocks[i * N + (N - 1 - j)]);
-            }
+            shape.rotate90Right();
         }
     }
 
@@ -523,6 +1515,9 @@ public:
         shape = new Shape(randomShape(), SHAPE_H, SHAPE_W);
         grid = new GridSystem(GRID_HEIGHT, GRID_WIDTH);
         screen = new Screen(nScreenWidth, nScreenHeight);
+        nextShapeType = randomShape();
+        autoPlay = false;
+        autoPlayPending = false;
     }
 
     ~GameManger()
@@ -535,12 +1530,14 @@ public:
     void run()
     {
         auto lastFallTime = std::chrono::high_resolution_clock::now();
+        auto lastBotStep = lastFallTime;
         int x = GRID_WIDTH / 2, y = 0;
         shape->setPosition(x, y);
         shape->setColor(randomColor());
         int score = 0;
         bool gameOver = false;
         int fullLine = -1;
+        size_t overlayRows = 0;
 
         while (true)
         {
@@ -550,25 +1547,74 @@ public:
 
             screen->print("Score: ", 0, 0);
             screen->print(std::to_string(score), 7, 0);
+            if (autoPlay)
+            {
+                screen->print("Bot nodes/s: ", 0, 2);
+                screen->print(std::to_string((long long)bot.search.nodesPerSecond()) + "    ", 13, 2);
+            }
+
+            // the overlay sits under the status lines; hiding it blanks them
+            std::vector<std::string> overlay = Profiler::visible() ? Profiler::lines() : std::vector<std::string>();
+            for (size_t i = 0; i < overlay.size(); i++)
+                screen->print(overlay[i], 0, 4 + (int)i);
+            for (size_t i = overlay.size(); i < overlayRows; i++)
+                screen->clearLine(4 + (int)i);
+            overlayRows = overlay.size();
 
-            if (grid->collision(*shape)[0] != 0)
+            {
+                PROFILE_SCOPE(PHASE_INPUT);
+                if (GetAsyncKeyState(VK_ESCAPE) & 0x8000)
+                    break;
+                if (GetAsyncKeyState(VK_F3) & 0b1)
+                    Profiler::toggle();
+                if (GetAsyncKeyState(VK_F4) & 0b1)
+                    Trace::write();
+
+                if (GetAsyncKeyState('P') & 0b1)
+                {
+                    if (autoPlay)
+                        autoPlay = false;
+                    else
+                        autoPlayPending = !autoPlayPending;
+                    screen->clearLine(2);
+                    if (autoPlayPending)
+                        screen->print("Bot takes the next piece", 0, 2);
+                }
+            }
+
+            bool landed;
+            {
+                PROFILE_SCOPE(PHASE_COLLISION);
+                landed = grid->collision(*shape)[0] != 0;
+            }
+            if (landed)
             {
                 if (shape->getY() <= 0)
                 {
                     gameOver = true;
                     screen->print("GAMEOVER", 0, 1);
+                    screen->draw(*grid);
                     screen->draw(*shape, L'\u2588');
-                    screen->draw(*grid, 1, L'\u2588');
                     screen->render();
                 }
                 else
                 {
+                    PROFILE_SCOPE(PHASE_UPDATE);
                     grid->placeShape(*shape);
                     delete shape;
-                    Shape *new_shape = new Shape(randomShape(), SHAPE_H, SHAPE_W);
+                    Shape *new_shape = new Shape(nextShapeType, SHAPE_H, SHAPE_W);
                     shape = new_shape;
                     shape->setPosition(x, y);
                     shape->setColor(randomColor());
+                    nextShapeType = randomShape();
+                    if (autoPlayPending)
+                    {
+                        autoPlay = true;
+                        autoPlayPending = false;
+                        screen->clearLine(2);
+                    }
+                    if (autoPlay)
+                        bot.replan(*grid, shape->getShapeType(), nextShapeType);
                 }
             }
 
@@ -576,32 +1622,132 @@ public:
             {
                 if (fullLine > 0)
                 {
+                    PROFILE_SCOPE(PHASE_SLEEP);
                     Sleep(150);
-                    grid->clearLines();
-                    score += fullLine;
                 }
-                fullLine = grid->markLines();
 
-                // control shape
-                control(*shape, grid->collision(*shape));
+                {
+                    PROFILE_SCOPE(PHASE_UPDATE);
+                    if (fullLine > 0)
+                    {
+                        grid->clearLines();
+                        score += fullLine;
+                    }
+                    fullLine = grid->markLines();
+
+                    // control shape
+                    std::chrono::duration<float> sinceBotStep = now - lastBotStep;
+                    if (!autoPlay)
+                    {
+                        control(*shape, grid->collision(*shape));
+                    }
+                    else if (sinceBotStep.count() >= 0.03f)
+                    {
+                        lastBotStep = now;
+                        bot.steer(*shape, grid->collision(*shape));
+                    }
+
+                    if (elapsed.count() >= 0.5f)
+                    {
+                        lastFallTime = now;
+                        shape->move(0, 1);
+                    }
+                }
 
-                if (elapsed.count() >= 0.5f)
                 {
-                    lastFallTime = now;
-                    shape->move(0, 1);
+                    PROFILE_SCOPE(PHASE_DRAW);
+                    screen->draw(*grid);
+                    screen->draw(*shape, L'#');
                 }
 
-                screen->draw(*shape, L'#');
-                screen->draw(*grid, 1, L'\u2588');
-                screen->draw(*grid, 2, L'*');
-                screen->render();
+                {
+                    PROFILE_SCOPE(PHASE_PRESENT);
+                    screen->render();
+                }
             }
+            Profiler::collect();
+            TRACE_COUNTER("score", score);
         }
+        Trace::write();
     }
 };
 
-int main()
+// Headless bot run: plays seeded games without a console and reports
+// search speed and lines per game.
+void benchmarkBot(int games, int maxPieces)
+{
+    if (games <= 0 || maxPieces <= 0)
+    {
+        std::cout << "games and max pieces must be positive\n";
+        return;
+    }
+
+    TetrisBot bot;
+    std::mt19937 gen(12345);
+    std::uniform_int_distribution<> dist(1, 7);
+    long long totalLines = 0;
+    long long totalPieces = 0;
+
+    for (int g = 0; g < games; g++)
+    {
+        BotBoard board;
+        int current = dist(gen);
+        int next = dist(gen);
+
+        for (int piece = 0; piece < maxPieces; piece++)
+        {
+            BotPlacement p = bot.choose(board, current, next);
+            if (p.rotation < 0)
+                break;
+
+            totalLines += board.place(bot.pieceRows(current, p.rotation), p.x, p.y);
+            totalPieces++;
+            current = next;
+            next = dist(gen);
+        }
+    }
+
+    std::cout << "games: " << games << " (max " << maxPieces << " pieces)\n";
+    std::cout << "workers: " << bot.getWorkers() << "\n";
+    std::cout << "lines/game: " << (double)totalLines / games << "\n";
+    std::cout << "pieces/game: " << (double)totalPieces / games << "\n";
+    std::cout << "nodes: " << bot.getNodes() << "\n";
+    std::cout << "nodes/s: " << (long long)bot.nodesPerSecond() << "\n";
+}
+
+int main(int argc, char *argv[])
 {
+    // tetris --versus             player (A/D/S/Space) against a bot
+    // tetris --battle [boards]    spectate bot matches
+    // tetris --battle-bench [boards] [ticks]
+    if (argc > 1 && std::string(argv[1]) == "--versus")
+    {
+        BattleMode battle(2, true, false);
+        battle.run(0, false);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--battle")
+    {
+        BattleMode battle(argc > 2 ? std::atoi(argv[2]) : 64, false, false);
+        battle.run(0, false);
+        return 0;
+    }
+    if (argc > 1 && std::string(argv[1]) == "--battle-bench")
+    {
+        BattleMode battle(argc > 2 ? std::atoi(argv[2]) : 64, false, true);
+        battle.run(argc > 3 ? std::atoi(argv[3]) : 2000, true);
+        return 0;
+    }
+
+    // tetris --bot-bench [games] [max pieces]
+    if (argc > 1 && std::string(argv[1]) == "--bot-bench")
+    {
+        int games = argc > 2 ? std::atoi(argv[2]) : 20;
+        int maxPieces = argc > 3 ? std::atoi(argv[3]) : 5000;
+        benchmarkBot(games, maxPieces);
+        return 0;
+    }
+
     GameManger tetris;
     tetris.run();
     std::cin.get();